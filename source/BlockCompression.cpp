@@ -0,0 +1,442 @@
+#include "pch.h"
+#include "BlockCompression.h"
+#include <atomic>
+#include <climits>
+#include <cstring>
+
+using namespace dae;
+
+namespace
+{
+	constexpr int NR_BLOCK_TEXELS{ BlockCompression::BLOCK_SIZE * BlockCompression::BLOCK_SIZE };
+
+	// direct mapped, 16 KB of texels per thread => stays in the cache next to the tiles of the uncompressed textures
+	constexpr int DECODED_BLOCK_CACHE_BITS{ 8 };
+	constexpr int DECODED_BLOCK_CACHE_SIZE{ 1 << DECODED_BLOCK_CACHE_BITS };
+
+	struct DecodedBlockCache
+	{
+		uint64_t keys[DECODED_BLOCK_CACHE_SIZE]{};
+		alignas(64) uint32_t texels[DECODED_BLOCK_CACHE_SIZE][NR_BLOCK_TEXELS]{};
+	};
+	thread_local DecodedBlockCache g_DecodedBlockCache{};
+
+	uint32_t GetChannel(uint32_t texel, int channel)
+	{
+		return (texel >> (channel * 8)) & 0xFF;
+	}
+
+	// 5:6:5 bits, blue in the low bits
+	uint16_t PackColor565(const float color[3])
+	{
+		const auto quantize{ [](float value, int maxValue)
+			{
+				return static_cast<uint16_t>(std::clamp(static_cast<int>(value * maxValue / 255.f + 0.5f), 0, maxValue));
+			} };
+		return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+	}
+
+	void UnpackColor565(uint16_t packed, int color[3])
+	{
+		// replicate the high bits into the low ones => 0 and the maximum map to 0 and 255
+		const int red{ (packed >> 11) & 31 };
+		const int green{ (packed >> 5) & 63 };
+		const int blue{ packed & 31 };
+		color[0] = (red << 3) | (red >> 2);
+		color[1] = (green << 2) | (green >> 4);
+		color[2] = (blue << 3) | (blue >> 2);
+	}
+
+	// c0 > c1 (or a BC3 block) => 2 endpoints + 2 colors in between, else 1 color in between + black
+	void BuildColorPalette(uint16_t color0, uint16_t color1, bool isFourColors, int palette[4][3])
+	{
+		UnpackColor565(color0, palette[0]);
+		UnpackColor565(color1, palette[1]);
+		for (int channel{}; channel < 3; ++channel)
+		{
+			if (isFourColors)
+			{
+				palette[2][channel] = (2 * palette[0][channel] + palette[1][channel] + 1) / 3;
+				palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel] + 1) / 3;
+			}
+			else
+			{
+				palette[2][channel] = (palette[0][channel] + palette[1][channel] + 1) / 2;
+				palette[3][channel] = 0;
+			}
+		}
+	}
+
+	// nearest palette color per texel, returns the squared error of the block
+	int SelectColorIndices(uint16_t color0, uint16_t color1, const int colors[NR_BLOCK_TEXELS][3], uint32_t& indices)
+	{
+		int palette[4][3]{};
+		BuildColorPalette(color0, color1, true, palette);
+
+		// equal endpoints => every texel is the first one
+		const int nrPaletteColors{ color0 == color1 ? 1 : 4 };
+		indices = 0;
+		int blockError{};
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			int bestIndex{};
+			int bestError{ INT_MAX };
+			for (int index{}; index < nrPaletteColors; ++index)
+			{
+				int error{};
+				for (int channel{}; channel < 3; ++channel)
+					error += (colors[texel][channel] - palette[index][channel]) * (colors[texel][channel] - palette[index][channel]);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = index;
+				}
+			}
+			indices |= static_cast<uint32_t>(bestIndex) << (texel * 2);
+			blockError += bestError;
+		}
+		return blockError;
+	}
+
+	// endpoints with c0 > c1 => the 4 color mode, also for BC1
+	// swapping the endpoints swaps the indices 0 <-> 1 and 2 <-> 3
+	void OrderEndpoints(uint16_t& color0, uint16_t& color1)
+	{
+		if (color0 < color1)
+			std::swap(color0, color1);
+	}
+
+	// endpoints along the principal axis of the colors (range fit), then one least squares refinement of the endpoints for the picked indices
+	void EncodeColorBlock(const uint32_t* pTexels, uint8_t* pBlock)
+	{
+		int colors[NR_BLOCK_TEXELS][3]{};
+		float mean[3]{};
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			for (int channel{}; channel < 3; ++channel)
+			{
+				colors[texel][channel] = static_cast<int>(GetChannel(pTexels[texel], channel));
+				mean[channel] += colors[texel][channel] / static_cast<float>(NR_BLOCK_TEXELS);
+			}
+		}
+
+		// covariance: xx, xy, xz, yy, yz, zz
+		float covariance[6]{};
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			const float x{ colors[texel][0] - mean[0] };
+			const float y{ colors[texel][1] - mean[1] };
+			const float z{ colors[texel][2] - mean[2] };
+			covariance[0] += x * x;
+			covariance[1] += x * y;
+			covariance[2] += x * z;
+			covariance[3] += y * y;
+			covariance[4] += y * z;
+			covariance[5] += z * z;
+		}
+
+		// power iteration, starting from the gray axis
+		float axis[3]{ 1.f, 1.f, 1.f };
+		for (int iteration{}; iteration < 8; ++iteration)
+		{
+			const float x{ covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2] };
+			const float y{ covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2] };
+			const float z{ covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+			const float largest{ std::max({ std::abs(x), std::abs(y), std::abs(z) }) };
+			if (largest < FLT_EPSILON)
+				break;
+			axis[0] = x / largest;
+			axis[1] = y / largest;
+			axis[2] = z / largest;
+		}
+
+		// the colors projected on the axis => the extremes are the endpoints
+		float minProjection{ FLT_MAX };
+		float maxProjection{ -FLT_MAX };
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			float projection{};
+			for (int channel{}; channel < 3; ++channel)
+				projection += (colors[texel][channel] - mean[channel]) * axis[channel];
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+
+		const float axisLengthSquared{ axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] };
+		float endpoint0[3]{};
+		float endpoint1[3]{};
+		for (int channel{}; channel < 3; ++channel)
+		{
+			endpoint0[channel] = mean[channel] + axis[channel] * maxProjection / axisLengthSquared;
+			endpoint1[channel] = mean[channel] + axis[channel] * minProjection / axisLengthSquared;
+		}
+
+		uint16_t color0{ PackColor565(endpoint0) };
+		uint16_t color1{ PackColor565(endpoint1) };
+		OrderEndpoints(color0, color1);
+		uint32_t indices{};
+		int blockError{ SelectColorIndices(color0, color1, colors, indices) };
+
+		// least squares endpoints for these indices: every texel is w * c0 + (1 - w) * c1
+		if (color0 != color1)
+		{
+			constexpr float weights[4]{ 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+			float weight00{};
+			float weight01{};
+			float weight11{};
+			float right0[3]{};
+			float right1[3]{};
+			for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+			{
+				const float weight{ weights[(indices >> (texel * 2)) & 3] };
+				const float inverseWeight{ 1.f - weight };
+				weight00 += weight * weight;
+				weight01 += weight * inverseWeight;
+				weight11 += inverseWeight * inverseWeight;
+				for (int channel{}; channel < 3; ++channel)
+				{
+					right0[channel] += weight * colors[texel][channel];
+					right1[channel] += inverseWeight * colors[texel][channel];
+				}
+			}
+
+			const float determinant{ weight00 * weight11 - weight01 * weight01 };
+			if (std::abs(determinant) > FLT_EPSILON)
+			{
+				for (int channel{}; channel < 3; ++channel)
+				{
+					endpoint0[channel] = (weight11 * right0[channel] - weight01 * right1[channel]) / determinant;
+					endpoint1[channel] = (weight00 * right1[channel] - weight01 * right0[channel]) / determinant;
+				}
+
+				uint16_t refinedColor0{ PackColor565(endpoint0) };
+				uint16_t refinedColor1{ PackColor565(endpoint1) };
+				OrderEndpoints(refinedColor0, refinedColor1);
+				uint32_t refinedIndices{};
+				const int refinedError{ SelectColorIndices(refinedColor0, refinedColor1, colors, refinedIndices) };
+				if (refinedError < blockError)
+				{
+					color0 = refinedColor0;
+					color1 = refinedColor1;
+					indices = refinedIndices;
+					blockError = refinedError;
+				}
+			}
+		}
+
+		std::memcpy(pBlock, &color0, sizeof(color0));
+		std::memcpy(pBlock + 2, &color1, sizeof(color1));
+		std::memcpy(pBlock + 4, &indices, sizeof(indices));
+	}
+
+	void DecodeColorBlock(const uint8_t* pBlock, bool isBC1, uint32_t* pTexels)
+	{
+		uint16_t color0{};
+		uint16_t color1{};
+		uint32_t indices{};
+		std::memcpy(&color0, pBlock, sizeof(color0));
+		std::memcpy(&color1, pBlock + 2, sizeof(color1));
+		std::memcpy(&indices, pBlock + 4, sizeof(indices));
+
+		// BC3 color blocks always have 4 colors
+		int palette[4][3]{};
+		const bool isFourColors{ !isBC1 || color0 > color1 };
+		BuildColorPalette(color0, color1, isFourColors, palette);
+
+		uint32_t paletteTexels[4]{};
+		for (int index{}; index < 4; ++index)
+			paletteTexels[index] = palette[index][0] | (palette[index][1] << 8) | (palette[index][2] << 16) | 0xFF000000;
+		// 3 color mode => index 3 is transparent black
+		if (!isFourColors)
+			paletteTexels[3] = 0;
+
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+			pTexels[texel] = paletteTexels[(indices >> (texel * 2)) & 3];
+	}
+
+	// a0 > a1 => 2 endpoints + 6 values in between
+	// a0 <= a1 => 2 endpoints + 4 values in between + 0 + 255
+	void BuildChannelPalette(int value0, int value1, int palette[8])
+	{
+		palette[0] = value0;
+		palette[1] = value1;
+		if (value0 > value1)
+		{
+			for (int index{ 2 }; index < 8; ++index)
+				palette[index] = ((8 - index) * value0 + (index - 1) * value1 + 3) / 7;
+		}
+		else
+		{
+			for (int index{ 2 }; index < 6; ++index)
+				palette[index] = ((6 - index) * value0 + (index - 1) * value1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	// endpoints at the minimum and maximum of the block, nearest palette value per texel
+	void EncodeChannelBlock(const uint32_t* pTexels, int channel, uint8_t* pBlock)
+	{
+		int values[NR_BLOCK_TEXELS]{};
+		int minValue{ 255 };
+		int maxValue{};
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			values[texel] = static_cast<int>(GetChannel(pTexels[texel], channel));
+			minValue = std::min(minValue, values[texel]);
+			maxValue = std::max(maxValue, values[texel]);
+		}
+
+		// one value => every texel is the first endpoint
+		int palette[8]{};
+		BuildChannelPalette(maxValue, minValue, palette);
+		const int nrPaletteValues{ maxValue == minValue ? 1 : 8 };
+
+		uint64_t indices{};
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			int bestIndex{};
+			for (int index{ 1 }; index < nrPaletteValues; ++index)
+			{
+				if (std::abs(values[texel] - palette[index]) < std::abs(values[texel] - palette[bestIndex]))
+					bestIndex = index;
+			}
+			indices |= static_cast<uint64_t>(bestIndex) << (texel * 3);
+		}
+
+		pBlock[0] = static_cast<uint8_t>(maxValue);
+		pBlock[1] = static_cast<uint8_t>(minValue);
+		// 48 bits of indices, little endian
+		for (int byte{}; byte < 6; ++byte)
+			pBlock[2 + byte] = static_cast<uint8_t>(indices >> (byte * 8));
+	}
+
+	void DecodeChannelBlock(const uint8_t* pBlock, uint8_t* pValues)
+	{
+		int palette[8]{};
+		BuildChannelPalette(pBlock[0], pBlock[1], palette);
+
+		uint64_t indices{};
+		for (int byte{}; byte < 6; ++byte)
+			indices |= static_cast<uint64_t>(pBlock[2 + byte]) << (byte * 8);
+
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+			pValues[texel] = static_cast<uint8_t>(palette[(indices >> (texel * 3)) & 7]);
+	}
+}
+
+int BlockCompression::GetBlockBytes(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:
+	case BlockFormat::BC4:
+		return 8;
+	case BlockFormat::BC3:
+	case BlockFormat::BC5:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+std::vector<uint8_t> BlockCompression::EncodeLevel(const std::vector<uint32_t>& texels, int width, int height, BlockFormat format)
+{
+	const int nrBlocksX{ (width + BLOCK_SIZE - 1) / BLOCK_SIZE };
+	const int nrBlocksY{ (height + BLOCK_SIZE - 1) / BLOCK_SIZE };
+	const int blockBytes{ GetBlockBytes(format) };
+	std::vector<uint8_t> blocks(nrBlocksX * nrBlocksY * blockBytes);
+
+	for (int blockY{}; blockY < nrBlocksY; ++blockY)
+	{
+		for (int blockX{}; blockX < nrBlocksX; ++blockX)
+		{
+			uint32_t blockTexels[NR_BLOCK_TEXELS]{};
+			for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+			{
+				const int x{ std::min(blockX * BLOCK_SIZE + texel % BLOCK_SIZE, width - 1) };
+				const int y{ std::min(blockY * BLOCK_SIZE + texel / BLOCK_SIZE, height - 1) };
+				blockTexels[texel] = texels[x + y * width];
+			}
+
+			uint8_t* pBlock{ &blocks[(blockX + blockY * nrBlocksX) * blockBytes] };
+			switch (format)
+			{
+			case BlockFormat::BC1:
+				EncodeColorBlock(blockTexels, pBlock);
+				break;
+			case BlockFormat::BC3:
+				EncodeChannelBlock(blockTexels, 3, pBlock);
+				EncodeColorBlock(blockTexels, pBlock + 8);
+				break;
+			case BlockFormat::BC4:
+				EncodeChannelBlock(blockTexels, 0, pBlock);
+				break;
+			case BlockFormat::BC5:
+				EncodeChannelBlock(blockTexels, 0, pBlock);
+				EncodeChannelBlock(blockTexels, 1, pBlock + 8);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	return blocks;
+}
+
+void BlockCompression::DecodeBlock(const uint8_t* pBlock, BlockFormat format, uint32_t* pTexels)
+{
+	uint8_t values[2][NR_BLOCK_TEXELS]{};
+	switch (format)
+	{
+	case BlockFormat::BC1:
+		DecodeColorBlock(pBlock, true, pTexels);
+		break;
+	case BlockFormat::BC3:
+		DecodeColorBlock(pBlock + 8, false, pTexels);
+		DecodeChannelBlock(pBlock, values[0]);
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+			pTexels[texel] = (pTexels[texel] & 0x00FFFFFF) | (static_cast<uint32_t>(values[0][texel]) << 24);
+		break;
+	case BlockFormat::BC4:
+		DecodeChannelBlock(pBlock, values[0]);
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+			pTexels[texel] = values[0][texel] * 0x00010101u | 0xFF000000;
+		break;
+	case BlockFormat::BC5:
+		DecodeChannelBlock(pBlock, values[0]);
+		DecodeChannelBlock(pBlock + 8, values[1]);
+		for (int texel{}; texel < NR_BLOCK_TEXELS; ++texel)
+		{
+			// x and y from range [0, 255] to [-1, 1], z = sqrt(1 - x * x - y * y) back to [0, 255]
+			const float x{ values[0][texel] / 127.5f - 1.f };
+			const float y{ values[1][texel] / 127.5f - 1.f };
+			const float z{ std::sqrt(std::max(1.f - x * x - y * y, 0.f)) };
+			const uint32_t encodedZ{ static_cast<uint32_t>((z + 1.f) * 127.5f + 0.5f) };
+			pTexels[texel] = values[0][texel] | (values[1][texel] << 8) | (encodedZ << 16) | 0xFF000000;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+const uint32_t* BlockCompression::GetDecodedBlock(uint64_t key, const uint8_t* pBlock, BlockFormat format)
+{
+	// fibonacci hashing: neighbouring blocks of a level land in different entries
+	DecodedBlockCache& cache{ g_DecodedBlockCache };
+	const size_t entry{ static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - DECODED_BLOCK_CACHE_BITS)) };
+	if (cache.keys[entry] != key)
+	{
+		DecodeBlock(pBlock, format, cache.texels[entry]);
+		cache.keys[entry] = key;
+	}
+	return cache.texels[entry];
+}
+
+uint32_t BlockCompression::NewCacheOwner()
+{
+	static std::atomic<uint32_t> nextOwner{ 1 };
+	return nextOwner++;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	// d3d block compressed formats, every block holds 4x4 texels
+	enum class BlockFormat
+	{
+		None,	// R8G8B8A8, not compressed
+		BC1,	// rgb, 8 bytes per block (4 bits per texel)
+		BC3,	// rgb + alpha, 16 bytes per block (8 bits per texel)
+		BC4,	// one channel (grayscale maps), 8 bytes per block (4 bits per texel)
+		BC5		// two channels (normal maps, z is rebuilt), 16 bytes per block (8 bits per texel)
+	};
+
+	// encoding at load, decoding in the software sampler
+	// texels are r, g, b, a from the low to the high byte (R8G8B8A8_UNORM), same as Texture
+	namespace BlockCompression
+	{
+		constexpr int BLOCK_SIZE{ 4 };
+
+		int GetBlockBytes(BlockFormat format);
+
+		// row major texels of a level to row major blocks, the blocks on the right and bottom edge repeat the last column / row
+		std::vector<uint8_t> EncodeLevel(const std::vector<uint32_t>& texels, int width, int height, BlockFormat format);
+
+		// 4x4 texels, row major
+		// BC4 => r, r, r, 255 (grayscale), BC5 => x, y, rebuilt z, 255 (unit length tangent space normal)
+		void DecodeBlock(const uint8_t* pBlock, BlockFormat format, uint32_t* pTexels);
+
+		// the decoded texels of a block out of a small cache per thread, decoded on a miss
+		// => sampling reads the compressed data once per block instead of decoding it per texel
+		// key: unique per block of every texture, see NewCacheOwner
+		const uint32_t* GetDecodedBlock(uint64_t key, const uint8_t* pBlock, BlockFormat format);
+		// unique id for the keys of a texture (never 0 => key 0 is an empty cache entry), ids of deleted textures aren't reused
+		uint32_t NewCacheOwner();
+	}
+}
@@ -30,10 +30,15 @@ dae::EffectShader::EffectShader(ID3D11Device* pDevice, const std::wstring& asset
 	m_pGlossinessMapVariable = m_pEffect->GetVariableByName("gGlossinessMap")->AsShaderResource();
 	if (!m_pGlossinessMapVariable->IsValid())
 		std::wcout << L"m_pGlossinessMapVariable not valid!\n";
+
+	m_pIsNormalMapXYVariable = m_pEffect->GetVariableByName("gIsNormalMapXY")->AsScalar();
+	if (!m_pIsNormalMapXYVariable->IsValid())
+		std::wcout << L"m_pIsNormalMapXYVariable not valid!\n";
 }
 
 dae::EffectShader::~EffectShader()
 {
+	m_pIsNormalMapXYVariable->Release();
 	m_pGlossinessMapVariable->Release();
 	m_pSpecularMapVariable->Release();
 	m_pNormalMapVariable->Release();
@@ -58,6 +63,12 @@ void dae::EffectShader::SetNormalMap(Texture* pNormalTexture)
 	{
 		m_pNormalMapVariable->SetResource(pNormalTexture->GetResourceView());
 	}
+
+	// BC5 => the shader rebuilds z
+	if (m_pIsNormalMapXYVariable)
+	{
+		m_pIsNormalMapXYVariable->SetBool(pNormalTexture->GetBlockFormat() == BlockFormat::BC5);
+	}
 }
 
 void dae::EffectShader::SetSpecularMap(Texture* pSpecularTexture)
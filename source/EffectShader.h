@@ -32,6 +32,7 @@ namespace dae
 		ID3DX11EffectShaderResourceVariable* m_pNormalMapVariable{};
 		ID3DX11EffectShaderResourceVariable* m_pSpecularMapVariable{};
 		ID3DX11EffectShaderResourceVariable* m_pGlossinessMapVariable{};
+		ID3DX11EffectScalarVariable* m_pIsNormalMapXYVariable{};
 
 	};
 }
\ No newline at end of file
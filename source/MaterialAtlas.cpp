@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "MaterialAtlas.h"
+#include "Texture.h"
+
+namespace dae
+{
+	MaterialAtlas* MaterialAtlas::Create(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGlossiness)
+	{
+		if (!pDiffuse || !pNormal || !pSpecular || !pGlossiness)
+			return nullptr;
+
+		const MipChain<uint32_t>* pMaps[NrMaps]{ &pDiffuse->GetMipChain(), &pNormal->GetMipChain(), &pSpecular->GetMipChain(), &pGlossiness->GetMipChain() };
+		const MipChain<uint32_t>& diffuse{ *pMaps[Diffuse] };
+		for (const MipChain<uint32_t>* pMap : pMaps)
+		{
+			if (pMap->GetWidth(0) != diffuse.GetWidth(0) || pMap->GetHeight(0) != diffuse.GetHeight(0))
+				return nullptr;
+		}
+
+		// same size => same number of levels
+		std::vector<std::vector<uint64_t>> levels(diffuse.GetNrLevels());
+		for (int level{}; level < diffuse.GetNrLevels(); ++level)
+		{
+			const int width{ diffuse.GetWidth(level) };
+			const int height{ diffuse.GetHeight(level) };
+			levels[level].resize(width * height);
+			for (int y{}; y < height; ++y)
+			{
+				for (int x{}; x < width; ++x)
+				{
+					// all maps are r, g, b, a from the low to the high byte
+					const uint32_t diffuseTexel{ pMaps[Diffuse]->GetTexel(level, x, y) };
+					const uint32_t normalTexel{ pMaps[Normal]->GetTexel(level, x, y) };
+					const uint32_t specularTexel{ pMaps[Specular]->GetTexel(level, x, y) };
+					const uint32_t glossinessTexel{ pMaps[Glossiness]->GetTexel(level, x, y) };
+
+					// rounded average of r, g and b
+					const uint32_t specularGray{ ((specularTexel & 0xFF) + ((specularTexel >> 8) & 0xFF) + ((specularTexel >> 16) & 0xFF) + 1) / 3 };
+					// grayscale map => its red channel, like the shading reads it
+					const uint32_t glossiness{ glossinessTexel & 0xFF };
+
+					const uint32_t low{ (diffuseTexel & 0x00FFFFFF) | (glossiness << 24) };
+					const uint32_t high{ (normalTexel & 0x00FFFFFF) | (specularGray << 24) };
+					levels[level][x + y * width] = low | (static_cast<uint64_t>(high) << 32);
+				}
+			}
+		}
+
+		MaterialAtlas* pAtlas{ new MaterialAtlas{} };
+		pAtlas->m_MipChain.Build(levels, diffuse.GetWidth(0), diffuse.GetHeight(0));
+		return pAtlas;
+	}
+
+	MaterialAtlas::MaterialTexels MaterialAtlas::Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy, SampleState sampleState) const
+	{
+		const uint64_t texel{ m_MipChain.Sample(uv, uvDx, uvDy, sampleState) };
+		const auto channel{ [&](int index)
+			{
+				// color range to [0 ,1]
+				return ((texel >> (index * 8)) & 0xFF) * m_DivideBy255;
+			} };
+
+		MaterialTexels texels{};
+		texels.maps[Diffuse] = { channel(0), channel(1), channel(2) };
+		texels.maps[Glossiness] = { channel(3), channel(3), channel(3) };
+		texels.maps[Normal] = { channel(4), channel(5), channel(6) };
+		texels.maps[Specular] = { channel(7), channel(7), channel(7) };
+		return texels;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "ColorRGB.h"
+#include "MipChain.h"
+
+namespace dae
+{
+	class Texture;
+
+	// the 4 maps of a material interleaved per texel, software only
+	// => one fetch serves the whole pixel shading instead of 4 fetches into 4 textures, a tile of 4x4 texels is 2 cache lines instead of 4
+	// 8 bytes per texel, from the low to the high byte: diffuse r, g, b, glossiness, normal x, y, z, specular
+	// the specular map is stored gray (average of its channels) to fit => a close approximation of colored specular maps
+	class MaterialAtlas final
+	{
+	public:
+		// same order as the Sample parameters of PixelShadingStage
+		enum Map
+		{
+			Diffuse,
+			Normal,
+			Specular,
+			Glossiness,
+			NrMaps
+		};
+
+		struct MaterialTexels
+		{
+			ColorRGB maps[NrMaps]{};
+		};
+
+		// nullptr if a map is missing or the maps don't have the same size
+		static MaterialAtlas* Create(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGlossiness);
+
+		// filtered like the d3d sampler states, see MipChain
+		MaterialTexels Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy, SampleState sampleState) const;
+
+	private:
+		MaterialAtlas() = default;
+
+		// level n interleaves level n of every map, not filtered again => the texels of the maps themselves, specular aside
+		MipChain<uint64_t> m_MipChain{};
+
+		float m_DivideBy255{ 1.f / 255.f };
+	};
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <immintrin.h>
+#include <cstdint>
+
+namespace dae
+{
+	// packets of 8 floats, one lane per fragment of a span
+	// avx2 only => only call when SIMD::DetectSimdLevel() returned SimdLevel::AVX2
+	// the basic operations are exact (ieee) => same result as the scalar Vector3/ColorRGB code, except for Pow
+	constexpr int PACKET_WIDTH{ 8 };
+
+	struct FloatPacket
+	{
+		__m256 value;
+
+		FloatPacket() = default;
+		FloatPacket(__m256 packet) : value{ packet } {}
+		explicit FloatPacket(float scalar) : value{ _mm256_set1_ps(scalar) } {}
+
+		static FloatPacket Load(const float* pValues) { return _mm256_loadu_ps(pValues); }
+		void Store(float* pValues) const { _mm256_storeu_ps(pValues, value); }
+
+		// 0, 1, 2, ... 7
+		static FloatPacket Lanes() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+		// left lane of the 2x2 quad every lane is in: 0, 0, 2, 2, ... 6
+		static FloatPacket QuadLanes() { return _mm256_setr_ps(0.f, 0.f, 2.f, 2.f, 4.f, 4.f, 6.f, 6.f); }
+
+		FloatPacket operator-() const { return _mm256_xor_ps(value, _mm256_set1_ps(-0.f)); }
+	};
+
+	inline FloatPacket operator+(FloatPacket a, FloatPacket b) { return _mm256_add_ps(a.value, b.value); }
+	inline FloatPacket operator-(FloatPacket a, FloatPacket b) { return _mm256_sub_ps(a.value, b.value); }
+	inline FloatPacket operator*(FloatPacket a, FloatPacket b) { return _mm256_mul_ps(a.value, b.value); }
+	inline FloatPacket operator/(FloatPacket a, FloatPacket b) { return _mm256_div_ps(a.value, b.value); }
+
+	inline FloatPacket Sqrt(FloatPacket a) { return _mm256_sqrt_ps(a.value); }
+	inline FloatPacket Max(FloatPacket a, FloatPacket b) { return _mm256_max_ps(a.value, b.value); }
+
+	// packet versions of the fast math in MathHelpers.h, same refinement => same max errors
+	inline FloatPacket FastInverseSqrt(FloatPacket a)
+	{
+		const FloatPacket estimate{ _mm256_rsqrt_ps(a.value) };
+		return estimate * (FloatPacket{ 1.5f } - FloatPacket{ 0.5f } * a * estimate * estimate);
+	}
+
+	inline FloatPacket FastReciprocal(FloatPacket a)
+	{
+		const FloatPacket estimate{ _mm256_rcp_ps(a.value) };
+		return estimate * (FloatPacket{ 2.f } - a * estimate);
+	}
+
+	// mask lanes all bits set => a, otherwise b
+	inline FloatPacket Select(FloatPacket mask, FloatPacket a, FloatPacket b) { return _mm256_blendv_ps(b.value, a.value, mask.value); }
+	inline FloatPacket Equal(FloatPacket a, FloatPacket b) { return _mm256_cmp_ps(a.value, b.value, _CMP_EQ_OQ); }
+	inline FloatPacket Less(FloatPacket a, FloatPacket b) { return _mm256_cmp_ps(a.value, b.value, _CMP_LT_OQ); }
+
+	struct Vector3Packet
+	{
+		FloatPacket x;
+		FloatPacket y;
+		FloatPacket z;
+
+		Vector3Packet operator-() const { return { -x, -y, -z }; }
+
+		// same operations as Vector3::Normalized
+		Vector3Packet Normalized() const
+		{
+			const FloatPacket magnitude{ Sqrt(x * x + y * y + z * z) };
+			return { x / magnitude, y / magnitude, z / magnitude };
+		}
+
+		// same operations as Vector3::NormalizedFast
+		Vector3Packet NormalizedFast() const
+		{
+			const FloatPacket inverseMagnitude{ FastInverseSqrt(x * x + y * y + z * z) };
+			return { x * inverseMagnitude, y * inverseMagnitude, z * inverseMagnitude };
+		}
+
+		static FloatPacket Dot(const Vector3Packet& v1, const Vector3Packet& v2) { return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z; }
+
+		static Vector3Packet Cross(const Vector3Packet& v1, const Vector3Packet& v2)
+		{
+			return { v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x };
+		}
+
+		// same operations as Vector3::Reflect
+		static Vector3Packet Reflect(const Vector3Packet& v1, const Vector3Packet& v2)
+		{
+			const FloatPacket scale{ FloatPacket{ 2.f } * Dot(v1, v2) };
+			return { v1.x - scale * v2.x, v1.y - scale * v2.y, v1.z - scale * v2.z };
+		}
+	};
+
+	struct ColorPacket
+	{
+		FloatPacket r;
+		FloatPacket g;
+		FloatPacket b;
+	};
+
+	inline ColorPacket operator+(const ColorPacket& c1, const ColorPacket& c2) { return { c1.r + c2.r, c1.g + c2.g, c1.b + c2.b }; }
+	inline ColorPacket operator*(const ColorPacket& c1, const ColorPacket& c2) { return { c1.r * c2.r, c1.g * c2.g, c1.b * c2.b }; }
+	inline ColorPacket operator*(const ColorPacket& c, FloatPacket s) { return { c.r * s, c.g * s, c.b * s }; }
+	inline ColorPacket operator/(const ColorPacket& c, FloatPacket s) { return { c.r / s, c.g / s, c.b / s }; }
+
+	// log2(x) for x > 0, exponent + series of atanh for the mantissa in [sqrt(0.5), sqrt(2))
+	// within ~1 ulp of the result for normal x (denormals are read as 2^-127)
+	inline FloatPacket Log2(FloatPacket x)
+	{
+		const __m256i bits{ _mm256_castps_si256(x.value) };
+		FloatPacket exponent{ _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))) };
+		FloatPacket mantissa{ _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000))) };
+
+		// [1, 2) => [sqrt(0.5), sqrt(2)), |t| <= 0.172 => 5 terms are enough
+		const FloatPacket isLarge{ Less(FloatPacket{ 1.41421356f }, mantissa) };
+		mantissa = Select(isLarge, mantissa * FloatPacket{ 0.5f }, mantissa);
+		exponent = Select(isLarge, exponent + FloatPacket{ 1.f }, exponent);
+
+		// ln(m) = 2 * atanh(t), t = (m - 1) / (m + 1)
+		const FloatPacket t{ (mantissa - FloatPacket{ 1.f }) / (mantissa + FloatPacket{ 1.f }) };
+		const FloatPacket t2{ t * t };
+		FloatPacket series{ FloatPacket{ 1.f / 9.f } };
+		series = series * t2 + FloatPacket{ 1.f / 7.f };
+		series = series * t2 + FloatPacket{ 1.f / 5.f };
+		series = series * t2 + FloatPacket{ 1.f / 3.f };
+		series = series * t2 + FloatPacket{ 1.f };
+
+		// 2 / ln(2)
+		return exponent + t * series * FloatPacket{ 2.88539008f };
+	}
+
+	// 2^y, integer part in the exponent bits + taylor series of e^(f * ln(2)) for the fraction in [-0.5, 0.5]
+	// max rel error 3e-7, y < -126 => 0
+	inline FloatPacket Exp2(FloatPacket y)
+	{
+		const FloatPacket isTooSmall{ Less(y, FloatPacket{ -126.f }) };
+		y = _mm256_min_ps(_mm256_max_ps(y.value, _mm256_set1_ps(-126.f)), _mm256_set1_ps(127.f));
+
+		const FloatPacket integer{ _mm256_round_ps(y.value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) };
+		const FloatPacket z{ (y - integer) * FloatPacket{ 0.693147181f } };
+
+		FloatPacket series{ FloatPacket{ 1.f / 720.f } };
+		series = series * z + FloatPacket{ 1.f / 120.f };
+		series = series * z + FloatPacket{ 1.f / 24.f };
+		series = series * z + FloatPacket{ 1.f / 6.f };
+		series = series * z + FloatPacket{ 0.5f };
+		series = series * z + FloatPacket{ 1.f };
+		series = series * z + FloatPacket{ 1.f };
+
+		const FloatPacket scale{ _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(integer.value), _mm256_set1_epi32(127)), 23)) };
+		return Select(isTooSmall, FloatPacket{ 0.f }, series * scale);
+	}
+
+	// x^y for x >= 0 and y >= 0, pow(x, 0) = 1 like powf
+	// measured against double pow for x in [0, 1], y in [0, 25] (the range phong uses):
+	// max abs error 3e-7, max rel error 2e-6 for results >= 1e-3 => at most 1 step of an 8 bit color channel
+	inline FloatPacket Pow(FloatPacket x, FloatPacket y)
+	{
+		const FloatPacket zero{ 0.f };
+		const FloatPacket one{ 1.f };
+
+		// log2(0) isn't finite => handle x = 0 separately
+		const FloatPacket isZero{ Equal(x, zero) };
+		const FloatPacket safeX{ Select(isZero, one, x) };
+		const FloatPacket result{ Exp2(y * Log2(safeX)) };
+
+		return Select(isZero, Select(Equal(y, zero), one, zero), result);
+	}
+}
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "Mesh.h"
 #include "Texture.h"
+#include "MaterialAtlas.h"
+#include "MeshOptimizer.h"
+#include "RasterizerSIMD.h"
 #include <cassert>
 
 using namespace dae;
@@ -10,6 +13,18 @@ dae::Mesh::Mesh(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, cons
 	, m_Vertices{ vertices }
 	, m_Indices{ indices }
 {
+	// Reorder for the post-transform cache, before the buffers and meshlets are built from it
+	if (m_PrimitiveTopology == PrimitiveTopology::TriangleList)
+	{
+		const float acmrBefore{ MeshOptimizer::ComputeACMR(m_Indices, m_Vertices.size()) };
+		MeshOptimizer::OptimizeVertexCache(m_Indices, m_Vertices.size());
+		MeshOptimizer::OptimizeVertexFetch(m_Vertices, m_Indices);
+		const float acmrAfter{ MeshOptimizer::ComputeACMR(m_Indices, m_Vertices.size()) };
+
+		std::cout << "Mesh: " << m_Indices.size() / 3 << " triangles, ACMR " << acmrBefore << " -> " << acmrAfter
+				  << " (FIFO " << MeshOptimizer::VERTEX_CACHE_SIZE << ")\n";
+	}
+
 	// Create Vertex Layout
 	static constexpr uint32_t numElements{ 6 };
 	D3D11_INPUT_ELEMENT_DESC vertexDesc[numElements]{};
@@ -86,6 +101,9 @@ dae::Mesh::Mesh(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, cons
 	result = pDevice->CreateBuffer(&bd, &initData, &m_pIndexBuffer);
 	if (FAILED(result))
 		return;
+
+	BuildVertexStreams();
+	BuildMeshlets();
 }
 
 dae::Mesh::~Mesh()
@@ -98,6 +116,8 @@ dae::Mesh::~Mesh()
 		delete m_pSpecularMap;
 	if (m_pGlossinessMap)
 		delete m_pGlossinessMap;
+	if (m_pMaterialAtlas)
+		delete m_pMaterialAtlas;
 
 	if (m_pIndexBuffer)
 		m_pIndexBuffer->Release();
@@ -149,6 +169,7 @@ void dae::Mesh::SetDiffuseMap(Texture* pDiffuseTexture)
 		delete m_pDiffuseMap;
 
 	m_pDiffuseMap = pDiffuseTexture;
+	ReleaseMaterialAtlas();
 }
 
 void dae::Mesh::SetNormalMap(Texture* pNormalTexture)
@@ -157,6 +178,7 @@ void dae::Mesh::SetNormalMap(Texture* pNormalTexture)
 		delete m_pNormalMap;
 
 	m_pNormalMap = pNormalTexture;
+	ReleaseMaterialAtlas();
 }
 
 void dae::Mesh::SetSpecularMap(Texture* pSpecularTexture)
@@ -165,6 +187,7 @@ void dae::Mesh::SetSpecularMap(Texture* pSpecularTexture)
 		delete m_pSpecularMap;
 
 	m_pSpecularMap = pSpecularTexture;
+	ReleaseMaterialAtlas();
 }
 
 void dae::Mesh::SetGlossinessMap(Texture* pGlossinessTexture)
@@ -173,6 +196,19 @@ void dae::Mesh::SetGlossinessMap(Texture* pGlossinessTexture)
 		delete m_pGlossinessMap;
 
 	m_pGlossinessMap = pGlossinessTexture;
+	ReleaseMaterialAtlas();
+}
+
+void dae::Mesh::BuildMaterialAtlas()
+{
+	ReleaseMaterialAtlas();
+	m_pMaterialAtlas = MaterialAtlas::Create(m_pDiffuseMap, m_pNormalMap, m_pSpecularMap, m_pGlossinessMap);
+}
+
+void dae::Mesh::ReleaseMaterialAtlas()
+{
+	delete m_pMaterialAtlas;
+	m_pMaterialAtlas = nullptr;
 }
 
 void dae::Mesh::GetHardwareInfo(Effect** pEffect, ID3D11InputLayout** pInputLayout, ID3D11Buffer** pVertexBuffer, ID3D11Buffer** pIndexBuffer, uint32_t& numIndices)
@@ -184,10 +220,10 @@ void dae::Mesh::GetHardwareInfo(Effect** pEffect, ID3D11InputLayout** pInputLayo
 	numIndices = m_NumIndices;
 }
 
-void dae::Mesh::GetSoftwareInfo(Matrix** pWorldMatrix, std::vector<Vertex>** pVertices, std::vector<uint32_t>** pIndices, PrimitiveTopology& primitiveTopology, std::vector<Vertex_Out>** pVertices_out, Texture** pDiffuseMap, Texture** pNormalMap, Texture** pSpecularMap, Texture** pGlossinessMap)
+void dae::Mesh::GetSoftwareInfo(Matrix** pWorldMatrix, const VertexStreams** pVertexStreams, std::vector<uint32_t>** pIndices, PrimitiveTopology& primitiveTopology, std::vector<Vertex_Out>** pVertices_out, Texture** pDiffuseMap, Texture** pNormalMap, Texture** pSpecularMap, Texture** pGlossinessMap)
 {
 	*pWorldMatrix = &m_WorldMatrix;
-	*pVertices = &m_Vertices;
+	*pVertexStreams = &m_VertexStreams;
 	*pIndices = &m_Indices;
 	primitiveTopology = m_PrimitiveTopology;
 	*pVertices_out = &m_Vertices_out;
@@ -198,3 +234,166 @@ void dae::Mesh::GetSoftwareInfo(Matrix** pWorldMatrix, std::vector<Vertex>** pVe
 	*pGlossinessMap = m_pGlossinessMap;
 }
 
+
+void dae::Mesh::GetMeshletInfo(const std::vector<Meshlet>** pMeshlets, const std::vector<uint32_t>** pMeshletVertices, const std::vector<uint8_t>** pMeshletTriangles) const
+{
+	*pMeshlets = &m_Meshlets;
+	*pMeshletVertices = &m_MeshletVertices;
+	*pMeshletTriangles = &m_MeshletTriangles;
+}
+
+void dae::Mesh::BuildVertexStreams()
+{
+	m_VertexStreams.nrVertices = static_cast<int>(m_Vertices.size());
+	if (m_Vertices.empty())
+		return;
+
+	const size_t nrPaddedVertices{ (m_Vertices.size() + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE * VERTEX_BATCH_SIZE };
+	const auto addVertex{ [&](const Vertex& vertex)
+		{
+			for (int axis{}; axis < 3; ++axis)
+			{
+				m_VertexStreams.position[axis].push_back(vertex.position[axis]);
+				m_VertexStreams.normal[axis].push_back(vertex.normal[axis]);
+				m_VertexStreams.tangent[axis].push_back(vertex.tangent[axis]);
+			}
+			m_VertexStreams.color[0].push_back(vertex.color.r);
+			m_VertexStreams.color[1].push_back(vertex.color.g);
+			m_VertexStreams.color[2].push_back(vertex.color.b);
+			m_VertexStreams.uv[0].push_back(vertex.uv.x);
+			m_VertexStreams.uv[1].push_back(vertex.uv.y);
+		} };
+
+	for (const Vertex& vertex : m_Vertices)
+		addVertex(vertex);
+
+	// padding: a real vertex => no nans or infs in the unused lanes
+	while (m_VertexStreams.position[0].size() < nrPaddedVertices)
+		addVertex(m_Vertices.back());
+}
+
+void dae::Mesh::BuildMeshlets()
+{
+	m_Meshlets.clear();
+	m_MeshletVertices.clear();
+	m_MeshletTriangles.clear();
+
+	// only triangle lists can be split freely
+	if (m_PrimitiveTopology != PrimitiveTopology::TriangleList)
+		return;
+
+	// local index of every mesh vertex in the meshlet being built, -1 => not in it yet
+	std::vector<int> localIndices(m_Vertices.size(), -1);
+
+	Meshlet meshlet{};
+
+	const auto finishMeshlet{ [&]()
+		{
+			if (meshlet.triangleCount == 0)
+				return;
+
+			ComputeMeshletBounds(meshlet);
+			m_Meshlets.emplace_back(meshlet);
+
+			for (uint32_t i{}; i < meshlet.vertexCount; ++i)
+				localIndices[m_MeshletVertices[meshlet.vertexOffset + i]] = -1;
+
+			meshlet = {};
+			meshlet.vertexOffset = static_cast<uint32_t>(m_MeshletVertices.size());
+			meshlet.triangleOffset = static_cast<uint32_t>(m_MeshletTriangles.size() / 3);
+		} };
+
+	// greedy, in index buffer order => triangles are submitted in the same order as without meshlets
+	for (size_t i{}; i + 2 < m_Indices.size(); i += 3)
+	{
+		const uint32_t triangle[3]{ m_Indices[i], m_Indices[i + 1], m_Indices[i + 2] };
+
+		uint32_t nrNewVertices{};
+		for (int corner{}; corner < 3; ++corner)
+		{
+			// a vertex used twice in the same triangle only counts once
+			const bool isRepeated{ (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]) };
+			if (localIndices[triangle[corner]] < 0 && !isRepeated)
+				++nrNewVertices;
+		}
+
+		if (meshlet.vertexCount + nrNewVertices > m_MaxMeshletVertices || meshlet.triangleCount + 1 > m_MaxMeshletTriangles)
+			finishMeshlet();
+
+		for (int corner{}; corner < 3; ++corner)
+		{
+			int& localIndex{ localIndices[triangle[corner]] };
+			if (localIndex < 0)
+			{
+				localIndex = static_cast<int>(meshlet.vertexCount++);
+				m_MeshletVertices.push_back(triangle[corner]);
+			}
+			m_MeshletTriangles.push_back(static_cast<uint8_t>(localIndex));
+		}
+		++meshlet.triangleCount;
+	}
+	finishMeshlet();
+}
+
+void dae::Mesh::ComputeMeshletBounds(Meshlet& meshlet) const
+{
+	// bounding sphere around the center of the bounding box
+	Vector3 minPosition{ m_Vertices[m_MeshletVertices[meshlet.vertexOffset]].position };
+	Vector3 maxPosition{ minPosition };
+	for (uint32_t i{}; i < meshlet.vertexCount; ++i)
+	{
+		const Vector3& position{ m_Vertices[m_MeshletVertices[meshlet.vertexOffset + i]].position };
+		minPosition = { std::min(minPosition.x, position.x), std::min(minPosition.y, position.y), std::min(minPosition.z, position.z) };
+		maxPosition = { std::max(maxPosition.x, position.x), std::max(maxPosition.y, position.y), std::max(maxPosition.z, position.z) };
+	}
+
+	meshlet.center = (minPosition + maxPosition) * 0.5f;
+	meshlet.radius = 0.f;
+	for (uint32_t i{}; i < meshlet.vertexCount; ++i)
+	{
+		const Vector3& position{ m_Vertices[m_MeshletVertices[meshlet.vertexOffset + i]].position };
+		meshlet.radius = std::max(meshlet.radius, (position - meshlet.center).Magnitude());
+	}
+
+	// normal cone: average of the triangle normals, opened up to the normal furthest away
+	std::vector<Vector3> normals{};
+	normals.reserve(meshlet.triangleCount);
+
+	Vector3 axis{};
+	for (uint32_t triangle{}; triangle < meshlet.triangleCount; ++triangle)
+	{
+		const size_t offset{ (meshlet.triangleOffset + triangle) * 3 };
+		const Vector3& position0{ m_Vertices[m_MeshletVertices[meshlet.vertexOffset + m_MeshletTriangles[offset]]].position };
+		const Vector3& position1{ m_Vertices[m_MeshletVertices[meshlet.vertexOffset + m_MeshletTriangles[offset + 1]]].position };
+		const Vector3& position2{ m_Vertices[m_MeshletVertices[meshlet.vertexOffset + m_MeshletTriangles[offset + 2]]].position };
+
+		const Vector3 normal{ Vector3::Cross(position1 - position0, position2 - position0) };
+		const float length{ normal.Magnitude() };
+
+		// degenerate => no direction
+		if (length <= FLT_EPSILON)
+			continue;
+
+		normals.emplace_back(normal / length);
+		axis += normals.back();
+	}
+
+	meshlet.coneAxis = Vector3::Zero;
+	meshlet.coneCutoff = 1.f;
+
+	const float axisLength{ axis.Magnitude() };
+	if (normals.empty() || axisLength <= FLT_EPSILON)
+		return;
+	axis /= axisLength;
+
+	float minDot{ 1.f };
+	for (const Vector3& normal : normals)
+		minDot = std::min(minDot, Vector3::Dot(normal, axis));
+
+	// cone wider than a half sphere => some triangle always faces the camera
+	if (minDot <= 0.f)
+		return;
+
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = sqrtf(1.f - minDot * minDot);
+}
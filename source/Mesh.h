@@ -5,6 +5,7 @@ namespace dae
 {
 	class Effect;
 	class Texture;
+	class MaterialAtlas;
 
 	struct Vertex final
 	{
@@ -26,6 +27,35 @@ namespace dae
 		Vector3 viewDirection{};
 	};
 
+	// software copy of the vertices, one array per component => the projection transforms a batch of vertices at once
+	// padded with copies of the last vertex to a multiple of VERTEX_BATCH_SIZE => every batch can be read whole
+	struct VertexStreams final
+	{
+		std::vector<float> position[3]{};
+		std::vector<float> color[3]{};
+		std::vector<float> uv[2]{};
+		std::vector<float> normal[3]{};
+		std::vector<float> tangent[3]{};
+		int nrVertices{};	// without the padding
+	};
+
+	// cluster of neighbouring triangles, culled as a whole by the software rasterizer
+	struct Meshlet final
+	{
+		uint32_t vertexOffset{};	// into the meshlet vertices (indices into the mesh vertices)
+		uint32_t vertexCount{};
+		uint32_t triangleOffset{};	// into the meshlet triangles (3 local vertex indices per triangle)
+		uint32_t triangleCount{};
+
+		// bounding sphere, object space
+		Vector3 center{};
+		float radius{};
+
+		// normal cone: every triangle normal lies within the cone around the axis
+		Vector3 coneAxis{};
+		float coneCutoff{ 1.f };	// sine of the cone angle, 1 => never culled
+	};
+
 	enum class PrimitiveTopology
 	{
 		TriangleList,
@@ -67,7 +97,7 @@ namespace dae
 
 		// access for software
 		void GetSoftwareInfo(	Matrix** pWorldMatrix, 
-								std::vector<Vertex>** pVertices,
+								const VertexStreams** pVertexStreams,
 								std::vector<uint32_t>** pIndices,
 								PrimitiveTopology& primitiveTopology,
 								std::vector<Vertex_Out>** pVertices_out, 
@@ -75,6 +105,16 @@ namespace dae
 								Texture** pNormalMap, 
 								Texture** pSpecularMap, 
 								Texture** pGlossinessMap);
+		// the 4 maps interleaved, nullptr unless built (and all 4 maps are set with the same size)
+		const MaterialAtlas* GetMaterialAtlas() const { return m_pMaterialAtlas; }
+		// 8 bytes per texel + mips => only built while settings.useMaterialAtlas asks for it, after all 4 maps are set
+		void BuildMaterialAtlas();
+		void ReleaseMaterialAtlas();
+
+		// access for meshlet culling (software)
+		void GetMeshletInfo(	const std::vector<Meshlet>** pMeshlets,
+								const std::vector<uint32_t>** pMeshletVertices,
+								const std::vector<uint8_t>** pMeshletTriangles) const;
 
 		bool IsOnlyForHardware() { return m_OnlyHardware; }
 
@@ -101,10 +141,26 @@ namespace dae
 		std::vector<uint32_t> m_Indices{};
 		PrimitiveTopology m_PrimitiveTopology{ PrimitiveTopology::TriangleList };
 		std::vector<Vertex_Out> m_Vertices_out{};
+		VertexStreams m_VertexStreams{};
+
+		void BuildVertexStreams();
+
+		// meshlets, built at load
+		static constexpr uint32_t m_MaxMeshletVertices{ 64 };
+		static constexpr uint32_t m_MaxMeshletTriangles{ 124 };
+		std::vector<Meshlet> m_Meshlets{};
+		std::vector<uint32_t> m_MeshletVertices{};
+		std::vector<uint8_t> m_MeshletTriangles{};
+
+		void BuildMeshlets();
+		void ComputeMeshletBounds(Meshlet& meshlet) const;
 
 		Texture* m_pDiffuseMap{ nullptr };
 		Texture* m_pNormalMap{ nullptr };
 		Texture* m_pSpecularMap{ nullptr };
 		Texture* m_pGlossinessMap{ nullptr };
+
+		// released whenever a map changes => never mixes old and new maps, the owner builds it again once all maps are set
+		MaterialAtlas* m_pMaterialAtlas{ nullptr };
 	};
 }
\ No newline at end of file
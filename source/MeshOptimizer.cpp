@@ -0,0 +1,207 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+
+using namespace dae;
+
+namespace
+{
+	// scoring from the original article
+	constexpr float CACHE_DECAY_POWER{ 1.5f };
+	constexpr float LAST_TRIANGLE_SCORE{ 0.75f };
+	constexpr float VALENCE_BOOST_SCALE{ 2.f };
+	constexpr float VALENCE_BOOST_POWER{ 0.5f };
+
+	float ComputeVertexScore(int cachePosition, int nrRemainingTriangles)
+	{
+		// no triangles left to draw => useless in the cache
+		if (nrRemainingTriangles == 0)
+			return -1.f;
+
+		float score{};
+		if (cachePosition >= 0)
+		{
+			// the vertices of the last triangle get a fixed score, otherwise they'd always win
+			if (cachePosition < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				const float scaler{ 1.f / (MeshOptimizer::VERTEX_CACHE_SIZE - 3) };
+				score = powf(1.f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+
+		// vertices with few triangles left get a boost => finish them off instead of leaving lone triangles behind
+		score += VALENCE_BOOST_SCALE * powf(static_cast<float>(nrRemainingTriangles), -VALENCE_BOOST_POWER);
+		return score;
+	}
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t nrVertices)
+{
+	const int nrTriangles{ static_cast<int>(indices.size() / 3) };
+	if (nrTriangles == 0)
+		return;
+
+	// triangles using each vertex
+	std::vector<int> adjacencyOffsets(nrVertices + 1, 0);
+	for (const uint32_t index : indices)
+		++adjacencyOffsets[index + 1];
+	for (size_t vertex{}; vertex < nrVertices; ++vertex)
+		adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+
+	std::vector<int> nrRemainingTriangles(nrVertices, 0);
+	std::vector<int> adjacentTriangles(indices.size());
+	for (int triangle{}; triangle < nrTriangles; ++triangle)
+	{
+		for (int corner{}; corner < 3; ++corner)
+		{
+			const uint32_t vertex{ indices[triangle * 3 + corner] };
+			adjacentTriangles[adjacencyOffsets[vertex] + nrRemainingTriangles[vertex]++] = triangle;
+		}
+	}
+
+	// scores
+	std::vector<int> cachePositions(nrVertices, -1);
+	std::vector<float> vertexScores(nrVertices);
+	for (size_t vertex{}; vertex < nrVertices; ++vertex)
+		vertexScores[vertex] = ComputeVertexScore(-1, nrRemainingTriangles[vertex]);
+
+	std::vector<float> triangleScores(nrTriangles);
+	std::vector<bool> isTriangleAdded(nrTriangles, false);
+	int bestTriangle{ 0 };
+	for (int triangle{}; triangle < nrTriangles; ++triangle)
+	{
+		triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+		if (triangleScores[triangle] > triangleScores[bestTriangle])
+			bestTriangle = triangle;
+	}
+
+	// lru cache, + 3 for the vertices that get pushed out by the new triangle
+	std::vector<uint32_t> cache{};
+	std::vector<uint32_t> newCache{};
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	newCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+	std::vector<uint32_t> optimizedIndices{};
+	optimizedIndices.reserve(indices.size());
+
+	int scanPosition{ 0 };
+	for (int nrAdded{}; nrAdded < nrTriangles; ++nrAdded)
+	{
+		// nothing useful in the cache => continue with the next triangle in the original order
+		if (bestTriangle < 0)
+		{
+			while (isTriangleAdded[scanPosition])
+				++scanPosition;
+			bestTriangle = scanPosition;
+		}
+
+		const uint32_t* pTriangle{ &indices[bestTriangle * 3] };
+		optimizedIndices.insert(optimizedIndices.end(), pTriangle, pTriangle + 3);
+		isTriangleAdded[bestTriangle] = true;
+
+		// remove the triangle from the adjacency of its vertices
+		for (int corner{}; corner < 3; ++corner)
+		{
+			const uint32_t vertex{ pTriangle[corner] };
+			int* pAdjacent{ &adjacentTriangles[adjacencyOffsets[vertex]] };
+			int& nrRemaining{ nrRemainingTriangles[vertex] };
+			for (int i{}; i < nrRemaining; ++i)
+			{
+				if (pAdjacent[i] == bestTriangle)
+				{
+					pAdjacent[i] = pAdjacent[--nrRemaining];
+					break;
+				}
+			}
+		}
+
+		// move the vertices of the triangle to the front of the cache
+		newCache.assign(pTriangle, pTriangle + 3);
+		for (const uint32_t vertex : cache)
+		{
+			if (vertex != pTriangle[0] && vertex != pTriangle[1] && vertex != pTriangle[2])
+				newCache.push_back(vertex);
+		}
+
+		for (int position{}; position < static_cast<int>(newCache.size()); ++position)
+		{
+			const uint32_t vertex{ newCache[position] };
+			cachePositions[vertex] = position < VERTEX_CACHE_SIZE ? position : -1;
+			vertexScores[vertex] = ComputeVertexScore(cachePositions[vertex], nrRemainingTriangles[vertex]);
+		}
+
+		// rescore the triangles around the touched vertices, the best one is drawn next
+		bestTriangle = -1;
+		float bestScore{ -1.f };
+		for (const uint32_t vertex : newCache)
+		{
+			const int* pAdjacent{ &adjacentTriangles[adjacencyOffsets[vertex]] };
+			for (int i{}; i < nrRemainingTriangles[vertex]; ++i)
+			{
+				const int triangle{ pAdjacent[i] };
+				const float score{ vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]] };
+				triangleScores[triangle] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		if (newCache.size() > VERTEX_CACHE_SIZE)
+			newCache.resize(VERTEX_CACHE_SIZE);
+		cache.swap(newCache);
+	}
+
+	indices.swap(optimizedIndices);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	constexpr uint32_t unused{ UINT32_MAX };
+	std::vector<uint32_t> remap(vertices.size(), unused);
+
+	std::vector<Vertex> optimizedVertices{};
+	optimizedVertices.reserve(vertices.size());
+
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<uint32_t>(optimizedVertices.size());
+			optimizedVertices.emplace_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(optimizedVertices);
+}
+
+float MeshOptimizer::ComputeACMR(const std::vector<uint32_t>& indices, size_t nrVertices, int cacheSize)
+{
+	const size_t nrTriangles{ indices.size() / 3 };
+	if (nrTriangles == 0)
+		return 0.f;
+
+	// fifo: a vertex is cached if fewer than cacheSize vertices entered after it
+	std::vector<int64_t> entryTimes(nrVertices, INT64_MIN / 2);
+	int64_t time{};
+	int64_t nrMisses{};
+
+	for (const uint32_t index : indices)
+	{
+		if (time - entryTimes[index] >= cacheSize)
+		{
+			entryTimes[index] = time++;
+			++nrMisses;
+		}
+	}
+
+	return static_cast<float>(nrMisses) / nrTriangles;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	struct Vertex;
+
+	// load time optimizations of triangle list index buffers
+	namespace MeshOptimizer
+	{
+		// post-transform cache size the triangle order is optimized and measured for
+		constexpr int VERTEX_CACHE_SIZE{ 32 };
+
+		// reorders the triangles for post-transform cache reuse (Tom Forsyth, linear-speed vertex cache optimisation)
+		void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t nrVertices);
+
+		// reorders the vertices in order of first use and drops the unused ones => near sequential vertex fetch
+		void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+		// average cache miss ratio: vertex transforms per triangle with a FIFO cache of cacheSize entries
+		// 3 => no reuse at all, 0.5 => the ideal for a large regular grid
+		float ComputeACMR(const std::vector<uint32_t>& indices, size_t nrVertices, int cacheSize = VERTEX_CACHE_SIZE);
+	}
+}
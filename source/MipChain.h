@@ -0,0 +1,354 @@
+#pragma once
+#include <type_traits>
+#include <vector>
+#include "BlockCompression.h"
+#include "MathHelpers.h"
+#include "SettingsStruct.h"
+#include "Vector2.h"
+
+namespace dae
+{
+	// most texels an anisotropic sample averages along the long side of the footprint, same limit for the d3d sampler
+	constexpr int MAX_ANISOTROPY{ 4 };
+
+	// mip levels of 8 bit channels packed in a Texel (4 in a uint32_t, 8 in a uint64_t) + the d3d sampler state filters on them
+	// every channel is filtered on its own => a filtered texel is still packed, the owner decodes it
+	template<typename Texel>
+	class MipChain final
+	{
+	public:
+		// average 2x2 texels of the previous level, every level halves the size (rounded down) down to 1x1
+		// odd sizes: the last row / column of the previous level is dropped, like d3d
+		static std::vector<std::vector<Texel>> BuildLevels(std::vector<Texel> level0, int width, int height);
+		// row major texels of every level
+		void Build(const std::vector<std::vector<Texel>>& levels, int width, int height);
+		// row major blocks of every level (uint32_t texels only), decoded on demand through the decoded block cache of the sampling thread
+		// => a quarter to an eighth of the memory of the texels, the tiles are exactly the blocks
+		void BuildCompressed(const std::vector<std::vector<uint8_t>>& levels, int width, int height, BlockFormat blockFormat);
+
+		// point and linear pick the level from the longest side of the footprint, anisotropic averages trilinear samples along it
+		// the uv derivatives over a pixel pick the mip level, zero derivatives => level 0
+		Texel Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy, SampleState sampleState) const;
+		Texel GetTexel(int level, int x, int y) const { return GetTexel(m_Levels[level], x, y); }	// wrap addressing, like the d3d sampler states
+
+		int GetNrLevels() const { return static_cast<int>(m_Levels.size()); }
+		int GetWidth(int level) const { return m_Levels[level].width; }
+		int GetHeight(int level) const { return m_Levels[level].height; }
+
+	private:
+		// 2 channels at a time in 16 bit lanes: 255 * 256 (a lerp) or 4 * 255 (a sum) still fits
+		static constexpr Texel m_LaneMask{ static_cast<Texel>(0x00FF00FF00FF00FFull) };
+		static constexpr int m_NrChannels{ sizeof(Texel) };
+
+		// tiles of 4x4 texels, one cache line for a uint32_t texel
+		// => texels that are close on screen are close in memory, whatever the orientation of the triangle
+		// tiles in row major order, texels row major inside a tile, size padded to whole tiles
+		static constexpr int m_TileSize{ 4 };
+		static_assert(m_TileSize == BlockCompression::BLOCK_SIZE, "a compressed tile is one block");
+		struct alignas(64) TexelTile
+		{
+			Texel texels[m_TileSize * m_TileSize]{};
+		};
+
+		struct Level
+		{
+			std::vector<TexelTile> tiles{};
+			std::vector<uint8_t> blocks{};	// compressed => instead of the tiles
+			uint64_t cacheKey{};			// owner and level of the decoded block cache keys, the block index is added
+			int width{};
+			int height{};
+			int nrTilesX{};
+			// power of two sizes wrap with a mask, the others with a modulo
+			int wrapMaskX{};
+			int wrapMaskY{};
+		};
+		std::vector<Level> m_Levels{};
+		bool m_IsPowerOfTwo{};
+		BlockFormat m_BlockFormat{ BlockFormat::None };
+		int m_BlockBytes{};
+
+		void BuildLevelSizes(int nrLevels, int width, int height);
+
+		float GetLevelOfDetail(const Vector2& uvDx, const Vector2& uvDy) const;
+		Texel SamplePoint(int level, const Vector2& uv) const;
+		Texel SampleBilinear(int level, const Vector2& uv) const;
+		Texel SampleTrilinear(float levelOfDetail, const Vector2& uv) const;
+		Texel SampleAnisotropic(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const;
+		Texel GetTexel(const Level& level, int x, int y) const;
+
+		static Texel LerpTexels(Texel texel0, Texel texel1, Texel weight);	// weight in [0, 256]
+	};
+
+	template<typename Texel>
+	std::vector<std::vector<Texel>> MipChain<Texel>::BuildLevels(std::vector<Texel> level0, int width, int height)
+	{
+		std::vector<std::vector<Texel>> levels{};
+		levels.push_back(std::move(level0));
+
+		const Texel rounding{ static_cast<Texel>(0x0002000200020002ull) };
+		while (width > 1 || height > 1)
+		{
+			const int parentWidth{ width };
+			const int parentHeight{ height };
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+
+			std::vector<Texel> level(width * height);
+			const std::vector<Texel>& parent{ levels.back() };
+			for (int y{}; y < height; ++y)
+			{
+				for (int x{}; x < width; ++x)
+				{
+					Texel evenSum{};
+					Texel oddSum{};
+					for (int offset{}; offset < 4; ++offset)
+					{
+						// a 1 texel wide parent reads its only column / row twice
+						const int parentX{ std::min(x * 2 + (offset & 1), parentWidth - 1) };
+						const int parentY{ std::min(y * 2 + (offset >> 1), parentHeight - 1) };
+						const Texel texel{ parent[parentX + parentY * parentWidth] };
+						evenSum += texel & m_LaneMask;
+						oddSum += (texel >> 8) & m_LaneMask;
+					}
+
+					// rounded average
+					level[x + y * width] = (((evenSum + rounding) >> 2) & m_LaneMask) | ((((oddSum + rounding) >> 2) & m_LaneMask) << 8);
+				}
+			}
+			levels.push_back(std::move(level));
+		}
+
+		return levels;
+	}
+
+	template<typename Texel>
+	void MipChain<Texel>::Build(const std::vector<std::vector<Texel>>& levels, int width, int height)
+	{
+		m_BlockFormat = BlockFormat::None;
+		BuildLevelSizes(static_cast<int>(levels.size()), width, height);
+		for (size_t levelIndex{}; levelIndex < levels.size(); ++levelIndex)
+		{
+			Level& level{ m_Levels[levelIndex] };
+			const int nrTilesY{ (level.height + m_TileSize - 1) / m_TileSize };
+			level.tiles.resize(level.nrTilesX * nrTilesY);
+
+			const std::vector<Texel>& texels{ levels[levelIndex] };
+			for (int y{}; y < level.height; ++y)
+			{
+				for (int x{}; x < level.width; ++x)
+					level.tiles[x / m_TileSize + (y / m_TileSize) * level.nrTilesX].texels[x % m_TileSize + (y % m_TileSize) * m_TileSize] = texels[x + y * level.width];
+			}
+		}
+	}
+
+	template<typename Texel>
+	void MipChain<Texel>::BuildCompressed(const std::vector<std::vector<uint8_t>>& levels, int width, int height, BlockFormat blockFormat)
+	{
+		static_assert(std::is_same_v<Texel, uint32_t>, "blocks decode to R8G8B8A8 texels");
+
+		m_BlockFormat = blockFormat;
+		m_BlockBytes = BlockCompression::GetBlockBytes(blockFormat);
+		BuildLevelSizes(static_cast<int>(levels.size()), width, height);
+
+		const uint64_t cacheOwner{ BlockCompression::NewCacheOwner() };
+		for (size_t levelIndex{}; levelIndex < levels.size(); ++levelIndex)
+		{
+			Level& level{ m_Levels[levelIndex] };
+			level.blocks = levels[levelIndex];
+			level.cacheKey = (cacheOwner << 40) | (static_cast<uint64_t>(levelIndex) << 32);
+		}
+	}
+
+	template<typename Texel>
+	void MipChain<Texel>::BuildLevelSizes(int nrLevels, int width, int height)
+	{
+		// halving a power of two keeps it a power of two, down to 1
+		m_IsPowerOfTwo = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+
+		m_Levels.clear();
+		m_Levels.resize(nrLevels);
+		for (Level& level : m_Levels)
+		{
+			level.width = width;
+			level.height = height;
+			level.nrTilesX = (width + m_TileSize - 1) / m_TileSize;
+			level.wrapMaskX = width - 1;
+			level.wrapMaskY = height - 1;
+
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy, SampleState sampleState) const
+	{
+		switch (sampleState)
+		{
+		case SampleState::Point:
+		{
+			// nearest level (MIN_MAG_MIP_POINT), magnified => level 0
+			const float levelOfDetail{ GetLevelOfDetail(uvDx, uvDy) };
+			const float lastLevel{ static_cast<float>(m_Levels.size() - 1) };
+			const int level{ levelOfDetail > 0.5f ? static_cast<int>(std::min(levelOfDetail + 0.5f, lastLevel)) : 0 };
+			return SamplePoint(level, uv);
+		}
+		case SampleState::Linear:
+			// MIN_MAG_MIP_LINEAR
+			return SampleTrilinear(GetLevelOfDetail(uvDx, uvDy), uv);
+		default:
+			return SampleAnisotropic(uv, uvDx, uvDy);
+		}
+	}
+
+	template<typename Texel>
+	float MipChain<Texel>::GetLevelOfDetail(const Vector2& uvDx, const Vector2& uvDy) const
+	{
+		// log2 of the longest side of the pixel footprint, in texels of level 0
+		// squared lengths => half of the log2, no square roots
+		// approximate log2, d3d keeps only 8 bits of fraction of the level as well
+		const Level& level0{ m_Levels[0] };
+		const float width{ static_cast<float>(level0.width) };
+		const float height{ static_cast<float>(level0.height) };
+		const float lengthDxSquared{ Square(uvDx.x * width) + Square(uvDx.y * height) };
+		const float lengthDySquared{ Square(uvDy.x * width) + Square(uvDy.y * height) };
+		return 0.5f * FastLog2(std::max(lengthDxSquared, lengthDySquared));
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::SamplePoint(int levelIndex, const Vector2& uv) const
+	{
+		//Sample the correct texel for the given uv
+		// uv range [0, 1] to range [0, texturewidth or height], wrapped outside of it
+		const Level& level{ m_Levels[levelIndex] };
+		const int x{ static_cast<int>(std::floor(uv.x * level.width)) };
+		const int y{ static_cast<int>(std::floor(uv.y * level.height)) };
+		return GetTexel(level, x, y);
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::SampleBilinear(int levelIndex, const Vector2& uv) const
+	{
+		// texel centers are at half texels
+		// 8 bits of sub texel precision for the weights, like d3d
+		const Level& level{ m_Levels[levelIndex] };
+		const float x{ uv.x * level.width - 0.5f };
+		const float y{ uv.y * level.height - 0.5f };
+		const float floorX{ std::floor(x) };
+		const float floorY{ std::floor(y) };
+		const Texel weightX{ static_cast<Texel>((x - floorX) * 256.f) };
+		const Texel weightY{ static_cast<Texel>((y - floorY) * 256.f) };
+
+		const int x0{ static_cast<int>(floorX) };
+		const int y0{ static_cast<int>(floorY) };
+		const Texel top{ LerpTexels(GetTexel(level, x0, y0), GetTexel(level, x0 + 1, y0), weightX) };
+		const Texel bottom{ LerpTexels(GetTexel(level, x0, y0 + 1), GetTexel(level, x0 + 1, y0 + 1), weightX) };
+		return LerpTexels(top, bottom, weightY);
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::SampleTrilinear(float levelOfDetail, const Vector2& uv) const
+	{
+		// magnified (or no footprint) => bilinear on level 0
+		if (!(levelOfDetail > 0.f))
+			return SampleBilinear(0, uv);
+
+		const int lastLevel{ static_cast<int>(m_Levels.size()) - 1 };
+		if (levelOfDetail >= static_cast<float>(lastLevel))
+			return SampleBilinear(lastLevel, uv);
+
+		const int level{ static_cast<int>(levelOfDetail) };
+		const Texel weight{ static_cast<Texel>((levelOfDetail - static_cast<float>(level)) * 256.f) };
+		const Texel texel{ SampleBilinear(level, uv) };
+		if (weight == 0)
+			return texel;
+		return LerpTexels(texel, SampleBilinear(level + 1, uv), weight);
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::SampleAnisotropic(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy) const
+	{
+		// cheap version of the hardware: up to MAX_ANISOTROPY trilinear samples spread evenly over the long side of the footprint,
+		// each covering its part of it => the level follows the short side instead of the long one (no blur on surfaces at grazing angles)
+		const Level& level0{ m_Levels[0] };
+		const float width{ static_cast<float>(level0.width) };
+		const float height{ static_cast<float>(level0.height) };
+		const float lengthDxSquared{ Square(uvDx.x * width) + Square(uvDx.y * height) };
+		const float lengthDySquared{ Square(uvDy.x * width) + Square(uvDy.y * height) };
+		const bool isMajorDx{ lengthDxSquared >= lengthDySquared };
+		const float majorSquared{ isMajorDx ? lengthDxSquared : lengthDySquared };
+		const float minorSquared{ isMajorDx ? lengthDySquared : lengthDxSquared };
+
+		// no footprint => bilinear on level 0
+		if (!(majorSquared > 0.f))
+			return SampleBilinear(0, uv);
+
+		// ratio of the sides, clamped => the level goes up again once the footprint is too stretched
+		const float maxAnisotropy{ static_cast<float>(MAX_ANISOTROPY) };
+		const float anisotropy{ minorSquared > 0.f ? std::min(std::sqrt(majorSquared / minorSquared), maxAnisotropy) : maxAnisotropy };
+		const int nrSamples{ std::clamp(static_cast<int>(std::ceil(anisotropy)), 1, MAX_ANISOTROPY) };
+		const float levelOfDetail{ 0.5f * FastLog2(majorSquared / Square(anisotropy)) };
+
+		if (nrSamples == 1)
+			return SampleTrilinear(levelOfDetail, uv);
+
+		// samples at the centers of nrSamples equal parts of the major axis, centered on the pixel
+		const Vector2& majorAxis{ isMajorDx ? uvDx : uvDy };
+		const float divideByNrSamples{ 1.f / nrSamples };
+		Texel evenSum{};
+		Texel oddSum{};
+		for (int sampleIndex{}; sampleIndex < nrSamples; ++sampleIndex)
+		{
+			const float offset{ (sampleIndex + 0.5f) * divideByNrSamples - 0.5f };
+			const Texel texel{ SampleTrilinear(levelOfDetail, uv + majorAxis * offset) };
+			evenSum += texel & m_LaneMask;
+			oddSum += (texel >> 8) & m_LaneMask;
+		}
+
+		// rounded average per channel
+		Texel average{};
+		for (int channel{}; channel < m_NrChannels; ++channel)
+		{
+			const Texel sum{ ((channel & 1 ? oddSum : evenSum) >> (channel / 2 * 16)) & 0xFFFF };
+			average |= (sum + nrSamples / 2) / nrSamples << (channel * 8);
+		}
+		return average;
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::GetTexel(const Level& level, int x, int y) const
+	{
+		// wrap addressing
+		uint32_t texelX{};
+		uint32_t texelY{};
+		if (m_IsPowerOfTwo)
+		{
+			texelX = static_cast<uint32_t>(x & level.wrapMaskX);
+			texelY = static_cast<uint32_t>(y & level.wrapMaskY);
+		}
+		else
+		{
+			texelX = static_cast<uint32_t>((x % level.width + level.width) % level.width);
+			texelY = static_cast<uint32_t>((y % level.height + level.height) % level.height);
+		}
+
+		// never negative => the divides and modulos are shifts and masks
+		const uint32_t tileIndex{ texelX / m_TileSize + (texelY / m_TileSize) * level.nrTilesX };
+		const uint32_t texelIndex{ texelX % m_TileSize + (texelY % m_TileSize) * m_TileSize };
+		if constexpr (std::is_same_v<Texel, uint32_t>)
+		{
+			if (m_BlockFormat != BlockFormat::None)
+				return BlockCompression::GetDecodedBlock(level.cacheKey | tileIndex, &level.blocks[tileIndex * m_BlockBytes], m_BlockFormat)[texelIndex];
+		}
+		return level.tiles[tileIndex].texels[texelIndex];
+	}
+
+	template<typename Texel>
+	Texel MipChain<Texel>::LerpTexels(Texel texel0, Texel texel1, Texel weight)
+	{
+		const Texel inverseWeight{ 256 - weight };
+		const Texel even{ (((texel0 & m_LaneMask) * inverseWeight + (texel1 & m_LaneMask) * weight) >> 8) & m_LaneMask };
+		const Texel odd{ (((texel0 >> 8) & m_LaneMask) * inverseWeight + ((texel1 >> 8) & m_LaneMask) * weight) & (m_LaneMask << 8) };
+		return even | odd;
+	}
+}
@@ -0,0 +1,646 @@
+#include "pch.h"
+#include "RasterizerSIMD.h"
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace dae;
+
+namespace
+{
+	// all kernels compute the depth of lane i as firstDepth + depthStepX * i (no fma)
+	// => every level writes exactly the same depth values and the images match bit for bit
+
+	uint32_t CoverageDepthScalar(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, float* pDepth, float* pOutDepth)
+	{
+		uint32_t mask{};
+
+		for (int lane{}; lane < SPAN_WIDTH; ++lane)
+		{
+			if (!(validMask & (1u << lane)))
+				continue;
+
+			const int64_t edge0{ edge[0] + setup.edgeLaneOffset[0][lane] };
+			const int64_t edge1{ edge[1] + setup.edgeLaneOffset[1][lane] };
+			const int64_t edge2{ edge[2] + setup.edgeLaneOffset[2][lane] };
+
+			if ((edge0 | edge1 | edge2) < 0)
+				continue;
+
+			const float depth{ firstDepth + setup.depthStepX * static_cast<float>(lane) };
+			if (!(depth < pDepth[lane]))
+				continue;
+
+			pDepth[lane] = depth;
+			pOutDepth[lane] = depth;
+			mask |= 1u << lane;
+		}
+
+		return mask;
+	}
+
+	// coverage: 2 pixels per register, sign bit of (e0 | e1 | e2) => outside
+	uint32_t CoverageMaskSSE4(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask)
+	{
+		uint32_t outsideMask{};
+		for (int pair{}; pair < SPAN_WIDTH / 2; ++pair)
+		{
+			__m128i combined{ _mm_setzero_si128() };
+			for (int i{}; i < 3; ++i)
+			{
+				const __m128i edgeValues{ _mm_add_epi64(_mm_set1_epi64x(edge[i]), _mm_loadu_si128(reinterpret_cast<const __m128i*>(&setup.edgeLaneOffset[i][pair * 2]))) };
+				combined = _mm_or_si128(combined, edgeValues);
+			}
+			outsideMask |= static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(combined))) << (pair * 2);
+		}
+
+		return validMask & ~outsideMask & 0xFFu;
+	}
+
+	// lanes of halfMask (4 bits) as an all ones/zeros mask per lane
+	__m128i LaneMaskSSE4(uint32_t halfMask)
+	{
+		const __m128i laneBits{ _mm_setr_epi32(1, 2, 4, 8) };
+		return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(static_cast<int>(halfMask)), laneBits), laneBits);
+	}
+
+	__m128 SpanDepthSSE4(const SpanSetup& setup, float firstDepth, int half)
+	{
+		const __m128 lanes{ _mm_setr_ps(0.f + half * 4, 1.f + half * 4, 2.f + half * 4, 3.f + half * 4) };
+		return _mm_add_ps(_mm_set1_ps(firstDepth), _mm_mul_ps(_mm_set1_ps(setup.depthStepX), lanes));
+	}
+
+	uint32_t CoverageDepthSSE4(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, float* pDepth, float* pOutDepth)
+	{
+		const uint32_t mask{ CoverageMaskSSE4(setup, edge, validMask) };
+		if (!mask)
+			return 0;
+
+		// depth: 4 pixels per register
+		uint32_t resultMask{};
+		for (int half{}; half < SPAN_WIDTH / 4; ++half)
+		{
+			const uint32_t halfMask{ (mask >> (half * 4)) & 0xFu };
+			if (!halfMask)
+				continue;
+
+			const __m128 depth{ SpanDepthSSE4(setup, firstDepth, half) };
+			const __m128 oldDepth{ _mm_loadu_ps(pDepth + half * 4) };
+			const __m128 passMask{ _mm_and_ps(_mm_castsi128_ps(LaneMaskSSE4(halfMask)), _mm_cmplt_ps(depth, oldDepth)) };
+
+			// masked depth write, the span never leaves the tile => the other lanes are ours to rewrite
+			_mm_storeu_ps(pDepth + half * 4, _mm_blendv_ps(oldDepth, depth, passMask));
+			_mm_storeu_ps(pOutDepth + half * 4, depth);
+
+			resultMask |= static_cast<uint32_t>(_mm_movemask_ps(passMask)) << (half * 4);
+		}
+
+		return resultMask;
+	}
+
+	// coverage: 4 pixels per register, sign bit of (e0 | e1 | e2) => outside
+	uint32_t CoverageMaskAVX2(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask)
+	{
+		__m256i combinedLow{ _mm256_setzero_si256() };
+		__m256i combinedHigh{ _mm256_setzero_si256() };
+		for (int i{}; i < 3; ++i)
+		{
+			const __m256i edgeStart{ _mm256_set1_epi64x(edge[i]) };
+			combinedLow = _mm256_or_si256(combinedLow, _mm256_add_epi64(edgeStart, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&setup.edgeLaneOffset[i][0]))));
+			combinedHigh = _mm256_or_si256(combinedHigh, _mm256_add_epi64(edgeStart, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&setup.edgeLaneOffset[i][4]))));
+		}
+
+		const uint32_t outsideMask{ static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(combinedLow)))
+								  | static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(combinedHigh))) << 4 };
+
+		return validMask & ~outsideMask & 0xFFu;
+	}
+
+	__m256i LaneMaskAVX2(uint32_t mask)
+	{
+		const __m256i laneBits{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+		return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), laneBits), laneBits);
+	}
+
+	__m256 SpanDepthAVX2(const SpanSetup& setup, float firstDepth)
+	{
+		const __m256 lanes{ _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
+		return _mm256_add_ps(_mm256_set1_ps(firstDepth), _mm256_mul_ps(_mm256_set1_ps(setup.depthStepX), lanes));
+	}
+
+	uint32_t CoverageDepthAVX2(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, float* pDepth, float* pOutDepth)
+	{
+		const uint32_t mask{ CoverageMaskAVX2(setup, edge, validMask) };
+		if (!mask)
+			return 0;
+
+		// depth: whole span in one register
+		const __m256 depth{ SpanDepthAVX2(setup, firstDepth) };
+		const __m256 oldDepth{ _mm256_loadu_ps(pDepth) };
+		const __m256 passMask{ _mm256_and_ps(_mm256_castsi256_ps(LaneMaskAVX2(mask)), _mm256_cmp_ps(depth, oldDepth, _CMP_LT_OQ)) };
+
+		// masked depth write, the span never leaves the tile => the other lanes are ours to rewrite
+		_mm256_storeu_ps(pDepth, _mm256_blendv_ps(oldDepth, depth, passMask));
+		_mm256_storeu_ps(pOutDepth, depth);
+
+		return static_cast<uint32_t>(_mm256_movemask_ps(passMask));
+	}
+
+	// inverted unorm depth, same conversion as EncodeDepthUnorm
+	// stored as uint32_t (unorm24, upper byte unused) or uint16_t (unorm16), the test passes when the new value is greater
+	template<typename DepthType>
+	uint32_t CoverageDepthUnormScalar(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, DepthType* pDepth, float* pOutDepth)
+	{
+		constexpr uint32_t maxValue{ DepthUnormMax<DepthType>() };
+		uint32_t mask{};
+
+		for (int lane{}; lane < SPAN_WIDTH; ++lane)
+		{
+			if (!(validMask & (1u << lane)))
+				continue;
+
+			const int64_t edge0{ edge[0] + setup.edgeLaneOffset[0][lane] };
+			const int64_t edge1{ edge[1] + setup.edgeLaneOffset[1][lane] };
+			const int64_t edge2{ edge[2] + setup.edgeLaneOffset[2][lane] };
+
+			if ((edge0 | edge1 | edge2) < 0)
+				continue;
+
+			const float depth{ firstDepth + setup.depthStepX * static_cast<float>(lane) };
+			const uint32_t value{ EncodeDepthUnorm(depth, maxValue) };
+			if (!(value > pDepth[lane]))
+				continue;
+
+			pDepth[lane] = static_cast<DepthType>(value);
+			pOutDepth[lane] = depth;
+			mask |= 1u << lane;
+		}
+
+		return mask;
+	}
+
+	template<uint32_t maxValue>
+	__m128i EncodeDepthUnormSSE4(__m128 depth)
+	{
+		// max(depth, 0) and min(.., 1) in the same operand order as the scalar version => same result for nan
+		const __m128 clamped{ _mm_min_ps(_mm_max_ps(depth, _mm_setzero_ps()), _mm_set1_ps(1.f)) };
+		const __m128 scaled{ _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f), clamped), _mm_set1_ps(static_cast<float>(maxValue - 1))), _mm_set1_ps(0.5f)) };
+		return _mm_add_epi32(_mm_cvttps_epi32(scaled), _mm_set1_epi32(1));
+	}
+
+	template<typename DepthType>
+	uint32_t CoverageDepthUnormSSE4(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, DepthType* pDepth, float* pOutDepth)
+	{
+		const uint32_t mask{ CoverageMaskSSE4(setup, edge, validMask) };
+		if (!mask)
+			return 0;
+
+		uint32_t resultMask{};
+		for (int half{}; half < SPAN_WIDTH / 4; ++half)
+		{
+			const uint32_t halfMask{ (mask >> (half * 4)) & 0xFu };
+			if (!halfMask)
+				continue;
+
+			const __m128 depth{ SpanDepthSSE4(setup, firstDepth, half) };
+			const __m128i value{ EncodeDepthUnormSSE4<DepthUnormMax<DepthType>()>(depth) };
+
+			// values stay below 2^24 => the signed compare works
+			DepthType* pHalf{ pDepth + half * 4 };
+			__m128i oldValue{};
+			if constexpr (sizeof(DepthType) == 2)
+				oldValue = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pHalf)));
+			else
+				oldValue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pHalf));
+
+			const __m128i passMask{ _mm_and_si128(LaneMaskSSE4(halfMask), _mm_cmpgt_epi32(value, oldValue)) };
+			const __m128i newValue{ _mm_blendv_epi8(oldValue, value, passMask) };
+
+			if constexpr (sizeof(DepthType) == 2)
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pHalf), _mm_packus_epi32(newValue, newValue));
+			else
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pHalf), newValue);
+			_mm_storeu_ps(pOutDepth + half * 4, depth);
+
+			resultMask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(passMask))) << (half * 4);
+		}
+
+		return resultMask;
+	}
+
+	template<uint32_t maxValue>
+	__m256i EncodeDepthUnormAVX2(__m256 depth)
+	{
+		const __m256 clamped{ _mm256_min_ps(_mm256_max_ps(depth, _mm256_setzero_ps()), _mm256_set1_ps(1.f)) };
+		const __m256 scaled{ _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), clamped), _mm256_set1_ps(static_cast<float>(maxValue - 1))), _mm256_set1_ps(0.5f)) };
+		return _mm256_add_epi32(_mm256_cvttps_epi32(scaled), _mm256_set1_epi32(1));
+	}
+
+	template<typename DepthType>
+	uint32_t CoverageDepthUnormAVX2(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, DepthType* pDepth, float* pOutDepth)
+	{
+		const uint32_t mask{ CoverageMaskAVX2(setup, edge, validMask) };
+		if (!mask)
+			return 0;
+
+		const __m256 depth{ SpanDepthAVX2(setup, firstDepth) };
+		const __m256i value{ EncodeDepthUnormAVX2<DepthUnormMax<DepthType>()>(depth) };
+
+		__m256i oldValue{};
+		if constexpr (sizeof(DepthType) == 2)
+			oldValue = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepth)));
+		else
+			oldValue = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDepth));
+
+		const __m256i passMask{ _mm256_and_si256(LaneMaskAVX2(mask), _mm256_cmpgt_epi32(value, oldValue)) };
+		const __m256i newValue{ _mm256_blendv_epi8(oldValue, value, passMask) };
+
+		if constexpr (sizeof(DepthType) == 2)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDepth), _mm_packus_epi32(_mm256_castsi256_si128(newValue), _mm256_extracti128_si256(newValue, 1)));
+		else
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDepth), newValue);
+		_mm256_storeu_ps(pOutDepth, depth);
+
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(passMask)));
+	}
+
+	void TransformBatchScalar(const float* const pIn[3], const float matrix[4][4], bool isPoint, int nrOutComponents, float* const pOut[4])
+	{
+		for (int component{}; component < nrOutComponents; ++component)
+		{
+			for (int lane{}; lane < VERTEX_BATCH_SIZE; ++lane)
+			{
+				float result{ matrix[0][component] * pIn[0][lane] + matrix[1][component] * pIn[1][lane] + matrix[2][component] * pIn[2][lane] };
+				if (isPoint)
+					result += matrix[3][component];
+				pOut[component][lane] = result;
+			}
+		}
+	}
+
+	void TransformBatchSSE4(const float* const pIn[3], const float matrix[4][4], bool isPoint, int nrOutComponents, float* const pOut[4])
+	{
+		// 4 vertices per register
+		for (int half{}; half < VERTEX_BATCH_SIZE / 4; ++half)
+		{
+			const __m128 x{ _mm_loadu_ps(pIn[0] + half * 4) };
+			const __m128 y{ _mm_loadu_ps(pIn[1] + half * 4) };
+			const __m128 z{ _mm_loadu_ps(pIn[2] + half * 4) };
+
+			for (int component{}; component < nrOutComponents; ++component)
+			{
+				__m128 result{ _mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix[0][component]), x), _mm_mul_ps(_mm_set1_ps(matrix[1][component]), y)) };
+				result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(matrix[2][component]), z));
+				if (isPoint)
+					result = _mm_add_ps(result, _mm_set1_ps(matrix[3][component]));
+				_mm_storeu_ps(pOut[component] + half * 4, result);
+			}
+		}
+	}
+
+	void TransformBatchAVX2(const float* const pIn[3], const float matrix[4][4], bool isPoint, int nrOutComponents, float* const pOut[4])
+	{
+		// whole batch in one register, no fma => same rounding as the other levels
+		const __m256 x{ _mm256_loadu_ps(pIn[0]) };
+		const __m256 y{ _mm256_loadu_ps(pIn[1]) };
+		const __m256 z{ _mm256_loadu_ps(pIn[2]) };
+
+		for (int component{}; component < nrOutComponents; ++component)
+		{
+			__m256 result{ _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(matrix[0][component]), x), _mm256_mul_ps(_mm256_set1_ps(matrix[1][component]), y)) };
+			result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_set1_ps(matrix[2][component]), z));
+			if (isPoint)
+				result = _mm256_add_ps(result, _mm256_set1_ps(matrix[3][component]));
+			_mm256_storeu_ps(pOut[component], result);
+		}
+	}
+
+	uint32_t PackColorScalar(float r, float g, float b, const PixelPacking& packing)
+	{
+		// ColorRGB::MaxToOne
+		const float maxValue{ std::max(r, std::max(g, b)) };
+		if (maxValue > 1.f)
+		{
+			r /= maxValue;
+			g /= maxValue;
+			b /= maxValue;
+		}
+
+		return packing.Pack(static_cast<uint8_t>(r * 255), static_cast<uint8_t>(g * 255), static_cast<uint8_t>(b * 255));
+	}
+
+	void PackColorsScalar(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels)
+	{
+		for (int pixel{}; pixel < nrPixels; ++pixel)
+			pPixels[pixel] = PackColorScalar(pColors[pixel * 3], pColors[pixel * 3 + 1], pColors[pixel * 3 + 2], packing);
+	}
+
+	// the float to uint8_t cast keeps the low 8 bits of the truncated int => mask instead of saturating
+	__m128i PackChannelSSE4(__m128 channel, __m128 divisor, int loss, int shift)
+	{
+		__m128i value{ _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(channel, divisor), _mm_set1_ps(255.f))) };
+		value = _mm_srl_epi32(_mm_and_si128(value, _mm_set1_epi32(0xFF)), _mm_cvtsi32_si128(loss));
+		return _mm_sll_epi32(value, _mm_cvtsi32_si128(shift));
+	}
+
+	void PackColorsSSE4(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels)
+	{
+		int pixel{};
+		for (; pixel + 4 <= nrPixels; pixel += 4)
+		{
+			const float* pColor{ pColors + pixel * 3 };
+			const __m128 r{ _mm_setr_ps(pColor[0], pColor[3], pColor[6], pColor[9]) };
+			const __m128 g{ _mm_setr_ps(pColor[1], pColor[4], pColor[7], pColor[10]) };
+			const __m128 b{ _mm_setr_ps(pColor[2], pColor[5], pColor[8], pColor[11]) };
+
+			// MaxToOne: divide by the max where it's above 1, by 1 (exact) elsewhere
+			// max_ps(b, a) == std::max(a, b), also for nan
+			const __m128 maxValue{ _mm_max_ps(_mm_max_ps(b, g), r) };
+			const __m128 divisor{ _mm_blendv_ps(_mm_set1_ps(1.f), maxValue, _mm_cmpgt_ps(maxValue, _mm_set1_ps(1.f))) };
+
+			__m128i packed{ _mm_set1_epi32(static_cast<int>(packing.alphaMask)) };
+			packed = _mm_or_si128(packed, PackChannelSSE4(r, divisor, packing.redLoss, packing.redShift));
+			packed = _mm_or_si128(packed, PackChannelSSE4(g, divisor, packing.greenLoss, packing.greenShift));
+			packed = _mm_or_si128(packed, PackChannelSSE4(b, divisor, packing.blueLoss, packing.blueShift));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + pixel), packed);
+		}
+
+		PackColorsScalar(pColors + pixel * 3, nrPixels - pixel, packing, pPixels + pixel);
+	}
+
+	__m256i PackChannelAVX2(__m256 channel, __m256 divisor, int loss, int shift)
+	{
+		__m256i value{ _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(channel, divisor), _mm256_set1_ps(255.f))) };
+		value = _mm256_srl_epi32(_mm256_and_si256(value, _mm256_set1_epi32(0xFF)), _mm_cvtsi32_si128(loss));
+		return _mm256_sll_epi32(value, _mm_cvtsi32_si128(shift));
+	}
+
+	void PackColorsAVX2(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels)
+	{
+		// r, g and b of 8 pixels are 3 floats apart
+		const __m256i offsets{ _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21) };
+
+		int pixel{};
+		for (; pixel + 8 <= nrPixels; pixel += 8)
+		{
+			const float* pColor{ pColors + pixel * 3 };
+			const __m256 r{ _mm256_i32gather_ps(pColor, offsets, sizeof(float)) };
+			const __m256 g{ _mm256_i32gather_ps(pColor + 1, offsets, sizeof(float)) };
+			const __m256 b{ _mm256_i32gather_ps(pColor + 2, offsets, sizeof(float)) };
+
+			const __m256 maxValue{ _mm256_max_ps(_mm256_max_ps(b, g), r) };
+			const __m256 divisor{ _mm256_blendv_ps(_mm256_set1_ps(1.f), maxValue, _mm256_cmp_ps(maxValue, _mm256_set1_ps(1.f), _CMP_GT_OQ)) };
+
+			__m256i packed{ _mm256_set1_epi32(static_cast<int>(packing.alphaMask)) };
+			packed = _mm256_or_si256(packed, PackChannelAVX2(r, divisor, packing.redLoss, packing.redShift));
+			packed = _mm256_or_si256(packed, PackChannelAVX2(g, divisor, packing.greenLoss, packing.greenShift));
+			packed = _mm256_or_si256(packed, PackChannelAVX2(b, divisor, packing.blueLoss, packing.blueShift));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pPixels + pixel), packed);
+		}
+
+		PackColorsSSE4(pColors + pixel * 3, nrPixels - pixel, packing, pPixels + pixel);
+	}
+
+	// srgb encoding of [0, 1] to 8 bits, by table instead of a pow per channel
+	// 4096 entries => at most 1 step off in the darkest values, where the curve is steepest
+	constexpr int GAMMA_TABLE_SIZE{ 4096 };
+
+	struct GammaTable
+	{
+		uint8_t values[GAMMA_TABLE_SIZE + 3]{};	// + 3 => a 32 bit gather at the last entry stays inside
+
+		GammaTable()
+		{
+			for (int index{}; index < GAMMA_TABLE_SIZE; ++index)
+			{
+				const float linear{ static_cast<float>(index) / (GAMMA_TABLE_SIZE - 1) };
+				const float encoded{ linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.f / 2.4f) - 0.055f };
+				values[index] = static_cast<uint8_t>(encoded * 255.f + 0.5f);
+			}
+		}
+	};
+	const GammaTable GAMMA_TABLE{};
+
+	// aces filmic fit (Narkowicz), clamped to [0, 1], nan => 0
+	float ToneMapScalar(float x)
+	{
+		const float mapped{ (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f) };
+		return mapped > 0.f ? (mapped < 1.f ? mapped : 1.f) : 0.f;
+	}
+
+	int GammaIndexScalar(float x)
+	{
+		return static_cast<int>(ToneMapScalar(x) * (GAMMA_TABLE_SIZE - 1) + 0.5f);
+	}
+
+	void ToneMapColorsScalar(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels)
+	{
+		for (int pixel{}; pixel < nrPixels; ++pixel)
+		{
+			const float* pColor{ pColors + pixel * 3 };
+			pPixels[pixel] = packing.Pack(GAMMA_TABLE.values[GammaIndexScalar(pColor[0])], GAMMA_TABLE.values[GammaIndexScalar(pColor[1])], GAMMA_TABLE.values[GammaIndexScalar(pColor[2])]);
+		}
+	}
+
+	// max(nan, 0) => 0, like the scalar clamp
+	__m128i GammaIndexSSE4(__m128 x)
+	{
+		const __m128 numerator{ _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(0.03f))) };
+		const __m128 denominator{ _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f)) };
+		const __m128 mapped{ _mm_min_ps(_mm_max_ps(_mm_div_ps(numerator, denominator), _mm_setzero_ps()), _mm_set1_ps(1.f)) };
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(mapped, _mm_set1_ps(GAMMA_TABLE_SIZE - 1.f)), _mm_set1_ps(0.5f)));
+	}
+
+	// no gather before avx2 => the table lookups are done per lane
+	__m128i GammaChannelSSE4(__m128 x, int loss, int shift)
+	{
+		alignas(16) int indices[4]{};
+		_mm_store_si128(reinterpret_cast<__m128i*>(indices), GammaIndexSSE4(x));
+
+		const __m128i value{ _mm_setr_epi32(GAMMA_TABLE.values[indices[0]], GAMMA_TABLE.values[indices[1]], GAMMA_TABLE.values[indices[2]], GAMMA_TABLE.values[indices[3]]) };
+		return _mm_sll_epi32(_mm_srl_epi32(value, _mm_cvtsi32_si128(loss)), _mm_cvtsi32_si128(shift));
+	}
+
+	void ToneMapColorsSSE4(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels)
+	{
+		int pixel{};
+		for (; pixel + 4 <= nrPixels; pixel += 4)
+		{
+			const float* pColor{ pColors + pixel * 3 };
+			const __m128 r{ _mm_setr_ps(pColor[0], pColor[3], pColor[6], pColor[9]) };
+			const __m128 g{ _mm_setr_ps(pColor[1], pColor[4], pColor[7], pColor[10]) };
+			const __m128 b{ _mm_setr_ps(pColor[2], pColor[5], pColor[8], pColor[11]) };
+
+			__m128i packed{ _mm_set1_epi32(static_cast<int>(packing.alphaMask)) };
+			packed = _mm_or_si128(packed, GammaChannelSSE4(r, packing.redLoss, packing.redShift));
+			packed = _mm_or_si128(packed, GammaChannelSSE4(g, packing.greenLoss, packing.greenShift));
+			packed = _mm_or_si128(packed, GammaChannelSSE4(b, packing.blueLoss, packing.blueShift));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + pixel), packed);
+		}
+
+		ToneMapColorsScalar(pColors + pixel * 3, nrPixels - pixel, packing, pPixels + pixel);
+	}
+
+	__m256i GammaChannelAVX2(__m256 x, int loss, int shift)
+	{
+		const __m256 numerator{ _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), x), _mm256_set1_ps(0.03f))) };
+		const __m256 denominator{ _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), x), _mm256_set1_ps(0.59f))), _mm256_set1_ps(0.14f)) };
+		const __m256 mapped{ _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(numerator, denominator), _mm256_setzero_ps()), _mm256_set1_ps(1.f)) };
+		const __m256i index{ _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(mapped, _mm256_set1_ps(GAMMA_TABLE_SIZE - 1.f)), _mm256_set1_ps(0.5f))) };
+
+		// 32 bit gather of the byte table, only the low byte is the entry
+		__m256i value{ _mm256_i32gather_epi32(reinterpret_cast<const int*>(GAMMA_TABLE.values), index, 1) };
+		value = _mm256_and_si256(value, _mm256_set1_epi32(0xFF));
+		return _mm256_sll_epi32(_mm256_srl_epi32(value, _mm_cvtsi32_si128(loss)), _mm_cvtsi32_si128(shift));
+	}
+
+	void ToneMapColorsAVX2(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels)
+	{
+		const __m256i offsets{ _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21) };
+
+		int pixel{};
+		for (; pixel + 8 <= nrPixels; pixel += 8)
+		{
+			const float* pColor{ pColors + pixel * 3 };
+			const __m256 r{ _mm256_i32gather_ps(pColor, offsets, sizeof(float)) };
+			const __m256 g{ _mm256_i32gather_ps(pColor + 1, offsets, sizeof(float)) };
+			const __m256 b{ _mm256_i32gather_ps(pColor + 2, offsets, sizeof(float)) };
+
+			__m256i packed{ _mm256_set1_epi32(static_cast<int>(packing.alphaMask)) };
+			packed = _mm256_or_si256(packed, GammaChannelAVX2(r, packing.redLoss, packing.redShift));
+			packed = _mm256_or_si256(packed, GammaChannelAVX2(g, packing.greenLoss, packing.greenShift));
+			packed = _mm256_or_si256(packed, GammaChannelAVX2(b, packing.blueLoss, packing.blueShift));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pPixels + pixel), packed);
+		}
+
+		ToneMapColorsSSE4(pColors + pixel * 3, nrPixels - pixel, packing, pPixels + pixel);
+	}
+}
+
+SimdLevel SIMD::DetectSimdLevel()
+{
+#if defined(_MSC_VER)
+	int info[4]{};
+	__cpuid(info, 0);
+	const int nrIds{ info[0] };
+
+	__cpuid(info, 1);
+	const bool hasSSE41{ (info[2] & (1 << 19)) != 0 };
+	const bool hasOSXSave{ (info[2] & (1 << 27)) != 0 };
+	const bool hasAVX{ (info[2] & (1 << 28)) != 0 };
+
+	bool hasAVX2{ false };
+	if (nrIds >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		hasAVX2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	// the os has to save the ymm registers as well
+	const bool osSavesYMM{ hasOSXSave && hasAVX && (_xgetbv(0) & 0x6) == 0x6 };
+
+	if (hasAVX2 && osSavesYMM)
+		return SimdLevel::AVX2;
+	if (hasSSE41)
+		return SimdLevel::SSE4;
+#else
+	if (__builtin_cpu_supports("avx2"))
+		return SimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return SimdLevel::SSE4;
+#endif
+	return SimdLevel::Scalar;
+}
+
+CoverageDepthFunction SIMD::GetCoverageDepthFunction(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return CoverageDepthAVX2;
+	case SimdLevel::SSE4:
+		return CoverageDepthSSE4;
+	default:
+		return CoverageDepthScalar;
+	}
+}
+
+CoverageDepthUnorm24Function SIMD::GetCoverageDepthUnorm24Function(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return CoverageDepthUnormAVX2<uint32_t>;
+	case SimdLevel::SSE4:
+		return CoverageDepthUnormSSE4<uint32_t>;
+	default:
+		return CoverageDepthUnormScalar<uint32_t>;
+	}
+}
+
+CoverageDepthUnorm16Function SIMD::GetCoverageDepthUnorm16Function(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return CoverageDepthUnormAVX2<uint16_t>;
+	case SimdLevel::SSE4:
+		return CoverageDepthUnormSSE4<uint16_t>;
+	default:
+		return CoverageDepthUnormScalar<uint16_t>;
+	}
+}
+
+TransformBatchFunction SIMD::GetTransformBatchFunction(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return TransformBatchAVX2;
+	case SimdLevel::SSE4:
+		return TransformBatchSSE4;
+	default:
+		return TransformBatchScalar;
+	}
+}
+
+PackColorsFunction SIMD::GetPackColorsFunction(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return PackColorsAVX2;
+	case SimdLevel::SSE4:
+		return PackColorsSSE4;
+	default:
+		return PackColorsScalar;
+	}
+}
+
+PackColorsFunction SIMD::GetToneMapColorsFunction(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return ToneMapColorsAVX2;
+	case SimdLevel::SSE4:
+		return ToneMapColorsSSE4;
+	default:
+		return ToneMapColorsScalar;
+	}
+}
+
+const char* SIMD::ToString(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::AVX2:
+		return "AVX2";
+	case SimdLevel::SSE4:
+		return "SSE4";
+	default:
+		return "SCALAR";
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <cfloat>
+#include <algorithm>
+
+namespace dae
+{
+	enum class SimdLevel
+	{
+		Scalar,
+		SSE4,
+		AVX2
+	};
+
+	// number of pixels the coverage/depth kernels handle per call
+	constexpr int SPAN_WIDTH{ 8 };
+
+	// per triangle data the span kernels need, filled in by triangle setup
+	struct SpanSetup
+	{
+		int64_t edgeLaneOffset[3][SPAN_WIDTH]{};	// edge step x * lane
+		float depthStepX{};
+	};
+
+	// tests coverage and depth for one span of SPAN_WIDTH pixels in a row
+	// edge: the 3 edge functions (fill rule bias included) at the first pixel of the span
+	// validMask: pixels of the span that lie inside the (clipped) bounding box
+	// returns the mask of pixels that are covered and closer, their depth is written to pDepth and pOutDepth
+	using CoverageDepthFunction = uint32_t(*)(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, float* pDepth, float* pOutDepth);
+
+	// unorm depth, stored inverted: 0 => cleared (behind everything), 1 => far plane (depth 1), max => near plane (depth 0)
+	// => a cleared buffer is all zeros, closer => bigger value, the depth test passes when the new value is greater
+	// the projection itself isn't reversed => same precision as plain unorm: a uniform step of 6e-8 for unorm24, 1.5e-5 for unorm16
+	// unorm24 matches the float buffer on this scene, unorm16 is too coarse (z fighting) and only kept as a reference for the benchmark
+	template<typename DepthType>
+	constexpr uint32_t DepthUnormMax()
+	{
+		// unorm24 is stored in the low bits of a uint32_t, like a d24x8 format
+		return sizeof(DepthType) == 2 ? 0xFFFFu : 0xFFFFFFu;
+	}
+
+	inline uint32_t EncodeDepthUnorm(float depth, uint32_t maxValue)
+	{
+		const float clamped{ std::min(1.f, std::max(0.f, depth)) };
+		return static_cast<uint32_t>((1.f - clamped) * static_cast<float>(maxValue - 1) + 0.5f) + 1;
+	}
+
+	// cleared => FLT_MAX, like the float depth buffer
+	inline float DecodeDepthUnorm(uint32_t value, uint32_t maxValue)
+	{
+		if (value == 0)
+			return FLT_MAX;
+		return 1.f - static_cast<float>(value - 1) / static_cast<float>(maxValue - 1);
+	}
+
+	// same as CoverageDepthFunction, for the inverted unorm depth buffers (DepthFormat::Unorm24 and DepthFormat::Unorm16)
+	// pOutDepth still gets the float depth
+	using CoverageDepthUnorm24Function = uint32_t(*)(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, uint32_t* pDepth, float* pOutDepth);
+	using CoverageDepthUnorm16Function = uint32_t(*)(const SpanSetup& setup, const int64_t edge[3], uint32_t validMask, float firstDepth, uint16_t* pDepth, float* pOutDepth);
+
+	// number of vertices the transform kernels handle per call
+	constexpr int VERTEX_BATCH_SIZE{ 8 };
+
+	// transforms VERTEX_BATCH_SIZE vectors, given as 3 streams (x, y, z), by a row-major matrix (row vectors, like Matrix)
+	// isPoint: w = 1 => the translation row is added, otherwise w = 0
+	// only the first nrOutComponents (3 or 4) columns are written to pOut
+	// same order of operations as Matrix::TransformPoint/TransformVector => same result as the scalar path
+	using TransformBatchFunction = void(*)(const float* const pIn[3], const float matrix[4][4], bool isPoint, int nrOutComponents, float* const pOut[4]);
+
+	// how a color is stored in a 32 bit back buffer pixel, read once from the surface format
+	// same result as SDL_MapRGB without going through the format for every pixel
+	struct PixelPacking
+	{
+		int redShift{};
+		int greenShift{};
+		int blueShift{};
+		int redLoss{};	// bits dropped from the 8 bit channel
+		int greenLoss{};
+		int blueLoss{};
+		uint32_t alphaMask{};	// alpha always opaque
+
+		uint32_t Pack(uint8_t r, uint8_t g, uint8_t b) const
+		{
+			return (static_cast<uint32_t>(r >> redLoss) << redShift) | (static_cast<uint32_t>(g >> greenLoss) << greenShift) | (static_cast<uint32_t>(b >> blueLoss) << blueShift) | alphaMask;
+		}
+	};
+
+	// converts nrPixels colors (r, g, b floats like ColorRGB) to back buffer pixels
+	// ColorRGB::MaxToOne, then * 255 truncated to 8 bits per channel => same pixels as the scalar WriteBackBufferPixel
+	using PackColorsFunction = void(*)(const float* pColors, int nrPixels, const PixelPacking& packing, uint32_t* pPixels);
+	// same signature, but a filmic tone map (aces fit) + srgb gamma instead of MaxToOne, every level gives the same pixels
+
+	namespace SIMD
+	{
+		// highest level supported by both the cpu and the os
+		SimdLevel DetectSimdLevel();
+		CoverageDepthFunction GetCoverageDepthFunction(SimdLevel level);
+		CoverageDepthUnorm24Function GetCoverageDepthUnorm24Function(SimdLevel level);
+		CoverageDepthUnorm16Function GetCoverageDepthUnorm16Function(SimdLevel level);
+		TransformBatchFunction GetTransformBatchFunction(SimdLevel level);
+		PackColorsFunction GetPackColorsFunction(SimdLevel level);
+		PackColorsFunction GetToneMapColorsFunction(SimdLevel level);
+		const char* ToString(SimdLevel level);
+	}
+}
@@ -7,6 +7,11 @@
 #include "pch.h"
 #include "RasterizerSoftware.h"
 #include "Texture.h"
+#include "MaterialAtlas.h"
+#include "ThreadPool.h"
+#include "MathSIMD.h"
+
+#include <bit>
 
 using namespace dae;
 
@@ -17,18 +22,88 @@ RasterizerSoftware::RasterizerSoftware(SDL_Window* pWindow, int width, int heigh
 	m_pBackBuffer = SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
 	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
 
-	m_pDepthBufferPixels = new float[width * height];
+	// the format doesn't change => read it once instead of SDL_MapRGB per pixel
+	const SDL_PixelFormat* pFormat{ m_pBackBuffer->format };
+	m_PixelPacking.redShift = pFormat->Rshift;
+	m_PixelPacking.greenShift = pFormat->Gshift;
+	m_PixelPacking.blueShift = pFormat->Bshift;
+	m_PixelPacking.redLoss = pFormat->Rloss;
+	m_PixelPacking.greenLoss = pFormat->Gloss;
+	m_PixelPacking.blueLoss = pFormat->Bloss;
+	m_PixelPacking.alphaMask = pFormat->Amask;
+
+	// rows padded to whole spans => span kernels never run into the next row
+	// rows padded to whole hierarchical z blocks => a block never runs out of the buffer
+	m_DepthBufferWidth = (width + SPAN_WIDTH - 1) / SPAN_WIDTH * SPAN_WIDTH;
+	m_DepthBufferHeight = (height + m_HiZBlockSize - 1) / m_HiZBlockSize * m_HiZBlockSize;
+	m_pDepthBufferPixels = new float[m_DepthBufferWidth * m_DepthBufferHeight];
+	m_pDepthBufferUnorm24 = new uint32_t[m_DepthBufferWidth * m_DepthBufferHeight];
+	m_pDepthBufferUnorm16 = new uint16_t[m_DepthBufferWidth * m_DepthBufferHeight];
+
+	// float color target, only cleared and used when settings.colorTarget asks for it
+	m_pColorTargetPixels = new ColorRGB[m_DepthBufferWidth * m_DepthBufferHeight];
+
+	// tiled layout, only used when settings.useTiledLayout asks for it
+	m_pTiledBackBufferPixels = new uint32_t[m_DepthBufferWidth * m_DepthBufferHeight];
+
+	// visibility buffer for deferred shading, empty between meshes
+	m_pVisibilityBuffer = new int[width * height];
+	std::fill_n(m_pVisibilityBuffer, width * height, m_InvalidTriangle);
+
+	// hierarchical z: max depth per block of the depth buffer
+	m_HiZWidth = m_DepthBufferWidth / m_HiZBlockSize;
+	m_HiZHeight = m_DepthBufferHeight / m_HiZBlockSize;
+	m_pHiZ = new float[m_HiZWidth * m_HiZHeight];
+
+	// plane compressed depth: one block per hierarchical z block
+	m_pDepthBlocks = new DepthBlock[m_HiZWidth * m_HiZHeight];
 
 	m_ScreenWidth = width;
 	m_ScreenHeight = height;
+
+	// tiles for binned rasterization
+	m_NrTilesX = (width + m_TileSize - 1) / m_TileSize;
+	m_NrTilesY = (height + m_TileSize - 1) / m_TileSize;
+	m_TileBins.resize(m_NrTilesX * m_NrTilesY);
+	m_TileStatistics.resize(m_NrTilesX * m_NrTilesY);
+	m_TileClearEpochs.resize(m_NrTilesX * m_NrTilesY, 0);
+
+	m_pThreadPool = new ThreadPool();
+
+	// pick the widest coverage/depth kernels this cpu can run
+	m_SimdLevel = SIMD::DetectSimdLevel();
+	m_pCoverageDepthSIMD = SIMD::GetCoverageDepthFunction(m_SimdLevel);
+	m_pCoverageDepthScalar = SIMD::GetCoverageDepthFunction(SimdLevel::Scalar);
+	m_pCoverageDepthUnorm24SIMD = SIMD::GetCoverageDepthUnorm24Function(m_SimdLevel);
+	m_pCoverageDepthUnorm24Scalar = SIMD::GetCoverageDepthUnorm24Function(SimdLevel::Scalar);
+	m_pCoverageDepthUnorm16SIMD = SIMD::GetCoverageDepthUnorm16Function(m_SimdLevel);
+	m_pCoverageDepthUnorm16Scalar = SIMD::GetCoverageDepthUnorm16Function(SimdLevel::Scalar);
+	m_pTransformBatchSIMD = SIMD::GetTransformBatchFunction(m_SimdLevel);
+	m_pTransformBatchScalar = SIMD::GetTransformBatchFunction(SimdLevel::Scalar);
+	m_pPackColorsSIMD = SIMD::GetPackColorsFunction(m_SimdLevel);
+	m_pPackColorsScalar = SIMD::GetPackColorsFunction(SimdLevel::Scalar);
+	m_pToneMapColorsSIMD = SIMD::GetToneMapColorsFunction(m_SimdLevel);
+	m_pToneMapColorsScalar = SIMD::GetToneMapColorsFunction(SimdLevel::Scalar);
+
+	BuildSpecularTable();
 }
 
 RasterizerSoftware::~RasterizerSoftware()
 {
+	// the front buffer is the window surface, owned by the window
+	SDL_FreeSurface(m_pBackBuffer);
+	delete m_pThreadPool;
 	delete[] m_pDepthBufferPixels;
+	delete[] m_pDepthBufferUnorm24;
+	delete[] m_pDepthBufferUnorm16;
+	delete[] m_pDepthBlocks;
+	delete[] m_pHiZ;
+	delete[] m_pVisibilityBuffer;
+	delete[] m_pColorTargetPixels;
+	delete[] m_pTiledBackBufferPixels;
 }
 
-void RasterizerSoftware::RenderStart(const DualRasterizerSettings& settings) const
+void RasterizerSoftware::RenderStart(const DualRasterizerSettings& settings)
 {
 	//Lock BackBuffer
 	SDL_LockSurface(m_pBackBuffer);
@@ -44,23 +119,57 @@ void RasterizerSoftware::RenderStart(const DualRasterizerSettings& settings) con
 		b = 0.39f;
 	}
 
+	m_ColorTarget = settings.colorTarget;
+	if (m_ColorTarget == ColorTarget::Direct)
+		m_pResolveColors = nullptr;
+	else if (m_ColorTarget == ColorTarget::HDR)
+		m_pResolveColors = settings.useSimd ? m_pPackColorsSIMD : m_pPackColorsScalar;
+	else
+		m_pResolveColors = settings.useSimd ? m_pToneMapColorsSIMD : m_pToneMapColorsScalar;
+
+	m_Statistics = {};
+
+	// new frame => no tile is cleared yet, only reset the stamps when the epoch wraps around
+	m_ClearColor = ColorRGB{ r, g, b };
+	m_UseLazyClear = settings.useLazyClear;
+	m_DepthFormat = settings.depthFormat;
+	m_SampleState = settings.sampleState;
+	m_UseTiledLayout = settings.useTiledLayout;
+	m_pRenderPixels = m_UseTiledLayout ? m_pTiledBackBufferPixels : m_pBackBufferPixels;
+	if (++m_FrameEpoch == 0)
+	{
+		std::fill(m_TileClearEpochs.begin(), m_TileClearEpochs.end(), 0);
+		m_FrameEpoch = 1;
+	}
+
+	if (m_UseLazyClear)
+		return;
+
+	// float color target => cleared in [0, 1], the resolve overwrites the whole back buffer
+	const int nrPaddedPixels{ m_DepthBufferWidth * m_DepthBufferHeight };
+	if (m_ColorTarget != ColorTarget::Direct)
+		std::fill_n(m_pColorTargetPixels, nrPaddedPixels, m_ClearColor);
+
 	// fill rect takes color values [0, 255] (rgb was [0,1])
 	r *= 255;
 	g *= 255;
 	b *= 255;
 
-	const int nrPixels{ m_ScreenWidth * m_ScreenHeight };
-	SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, r, g, b));
-	std::fill_n(m_pDepthBufferPixels, nrPixels, FLT_MAX);
+	const uint32_t clearPixel{ m_PixelPacking.Pack(static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)) };
+	if (m_ColorTarget == ColorTarget::Direct && m_UseTiledLayout)
+		std::fill_n(m_pTiledBackBufferPixels, nrPaddedPixels, clearPixel);
+	else if (m_ColorTarget == ColorTarget::Direct)
+		SDL_FillRect(m_pBackBuffer, NULL, clearPixel);
+	ClearDepth(0, 0, m_DepthBufferWidth, m_DepthBufferHeight, m_Statistics);
 }
 
-void RasterizerSoftware::RenderMesh(const DualRasterizerSettings& settings, const Camera& camera, Mesh* mesh) const
+void RasterizerSoftware::RenderMesh(const DualRasterizerSettings& settings, const Camera& camera, Mesh* mesh)
 {
 	if (mesh->IsOnlyForHardware())
 		return;
 	// get info for software rasterizing
 	Matrix* pWorldMatrix{};
-	std::vector<Vertex>* pVertices{};
+	const VertexStreams* pVertexStreams{};
 	std::vector<uint32_t>* pIndices{};
 	PrimitiveTopology primitiveTopology{};
 	std::vector<Vertex_Out>* pVerticesOut{};
@@ -68,68 +177,281 @@ void RasterizerSoftware::RenderMesh(const DualRasterizerSettings& settings, cons
 	Texture* pNormalMap{};
 	Texture* pSpecularMap{};
 	Texture* pGlossinessMap{};
-	mesh->GetSoftwareInfo(&pWorldMatrix, &pVertices, &pIndices, primitiveTopology, &pVerticesOut, &pDiffuseMap, &pNormalMap, &pSpecularMap, &pGlossinessMap);
+	mesh->GetSoftwareInfo(&pWorldMatrix, &pVertexStreams, &pIndices, primitiveTopology, &pVerticesOut, &pDiffuseMap, &pNormalMap, &pSpecularMap, &pGlossinessMap);
+	m_pMaterialAtlas = mesh->GetMaterialAtlas();
 
-	ProjectionStage(camera, pWorldMatrix, pVertices, pVerticesOut);
+	// meshlet culling => only visible meshlets get their vertices transformed and triangles set up
+	const std::vector<uint8_t>* pVertexMask{ nullptr };
+	if (settings.useMeshletCulling)
+	{
+		const std::vector<Meshlet>* pMeshlets{};
+		const std::vector<uint32_t>* pMeshletVertices{};
+		const std::vector<uint8_t>* pMeshletTriangles{};
+		mesh->GetMeshletInfo(&pMeshlets, &pMeshletVertices, &pMeshletTriangles);
+
+		if (!pMeshlets->empty())
+		{
+			CullMeshlets(settings, camera, *pWorldMatrix, *pMeshlets, *pMeshletVertices, *pMeshletTriangles, pVertexStreams->nrVertices);
+			pIndices = &m_VisibleIndices;
+			primitiveTopology = PrimitiveTopology::TriangleList;
+			pVertexMask = &m_VisibleVertices;
+		}
+	}
+
+	ProjectionStage(settings, camera, pWorldMatrix, pVertexStreams, pVertexMask, pVerticesOut);
 	RasterizationStage(settings, pVerticesOut, pIndices, primitiveTopology, pDiffuseMap, pNormalMap, pSpecularMap, pGlossinessMap);
 	// rasterization will call pixelShading per pixel
 }
 
 void RasterizerSoftware::RenderFinish(SDL_Window* pWindow) const
 {
+	ResolveFrame();
+
 	//Update SDL Surface
-	SDL_UnlockSurface(m_pBackBuffer);
 	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
 	SDL_UpdateWindowSurface(pWindow);
 }
 
-void RasterizerSoftware::ProjectionStage(const Camera& camera, Matrix* pWorldMatrix, std::vector<Vertex>* pVertices, std::vector<Vertex_Out>* pVerticesOut) const
+void RasterizerSoftware::ResolveFrame() const
+{
+	if (m_UseLazyClear)
+		ClearUntouchedTiles();
+
+	if (m_ColorTarget != ColorTarget::Direct)
+		ResolveColorTarget();
+	else if (m_UseTiledLayout)
+		DetileBackBuffer();
+
+	SDL_UnlockSurface(m_pBackBuffer);
+}
+
+std::vector<uint32_t> RasterizerSoftware::CopyBackBuffer() const
+{
+	// rows of the surface can be padded => pitch
+	const int width{ m_pBackBuffer->w };
+	const int height{ m_pBackBuffer->h };
+	std::vector<uint32_t> pixels(width * height);
+	for (int y{}; y < height; ++y)
+	{
+		const uint32_t* pRow{ reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(m_pBackBuffer->pixels) + y * m_pBackBuffer->pitch) };
+		std::copy_n(pRow, width, pixels.begin() + y * width);
+	}
+	return pixels;
+}
+
+void RasterizerSoftware::ProjectionStage(const DualRasterizerSettings& settings, const Camera& camera, Matrix* pWorldMatrix, const VertexStreams* pVertexStreams, const std::vector<uint8_t>* pVertexMask, std::vector<Vertex_Out>* pVerticesOut)
 {
 	const Matrix worldViewProjectionMatrix{ (*pWorldMatrix) * camera.viewMatrix * camera.projectionMatrix };
-	pVerticesOut->clear();
-	pVerticesOut->reserve(pVertices->size());
+	for (int row{}; row < 4; ++row)
+	{
+		for (int column{}; column < 4; ++column)
+		{
+			m_VertexTransform.worldViewProjection[row][column] = worldViewProjectionMatrix[row][column];
+			m_VertexTransform.world[row][column] = (*pWorldMatrix)[row][column];
+		}
+	}
+	m_VertexTransform.cameraOrigin = camera.origin;
+	m_VertexTransform.pVertexStreams = pVertexStreams;
+	m_VertexTransform.pTransformBatch = settings.useSimd ? m_pTransformBatchSIMD : m_pTransformBatchScalar;
+	m_VertexTransform.isDepthOnly = settings.showDepthBuffer;
+
+	// one output per vertex (vertices added by clipping are dropped)
+	const int nrVertices{ pVertexStreams->nrVertices };
+	pVerticesOut->resize(nrVertices);
+	m_ClipPositions.resize(nrVertices);
+	m_ClipCodes.resize(nrVertices);
+
+	// new mesh => nothing is transformed yet, only clear the stamps when the epoch wraps around
+	const int nrBatches{ (nrVertices + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE };
+	m_TransformEpochs.resize(std::max(m_TransformEpochs.size(), static_cast<size_t>(nrBatches)), 0);
+	if (++m_TransformEpoch == 0)
+	{
+		std::fill(m_TransformEpochs.begin(), m_TransformEpochs.end(), 0);
+		m_TransformEpoch = 1;
+	}
+
+	// large mesh => transform it up front on all cores, lazily transforming it would keep it on this thread
+	const bool isParallel{ nrVertices >= m_ParallelTransformThreshold };
+
+	// lazy => triangle assembly transforms the vertices it uses, the vertex mask isn't needed
+	if (settings.useLazyTransform && !isParallel)
+		return;
+
+	const auto transformBatches{ [&](int firstBatch, int lastBatch)
+		{
+			int nrTransformed{};
+			for (int batchIndex{ firstBatch }; batchIndex < lastBatch; ++batchIndex)
+			{
+				// only used by culled meshlets => no triangle will read it
+				if (pVertexMask)
+				{
+					const int firstVertex{ batchIndex * VERTEX_BATCH_SIZE };
+					const int lastVertex{ std::min(firstVertex + VERTEX_BATCH_SIZE, nrVertices) };
+					if (std::none_of(pVertexMask->begin() + firstVertex, pVertexMask->begin() + lastVertex, [](uint8_t isUsed) { return isUsed; }))
+						continue;
+				}
+
+				nrTransformed += TransformBatch(batchIndex, pVerticesOut);
+			}
+			return nrTransformed;
+		} };
+
+	if (!isParallel)
+	{
+		m_Statistics.nrVerticesTransformed += transformBatches(0, nrBatches);
+		return;
+	}
 
-	for (const Vertex& currentVertex : *pVertices)
+	// chunks don't share vertices (or batches) => no synchronization needed besides the counter
+	constexpr int batchesPerChunk{ m_TransformChunkSize / VERTEX_BATCH_SIZE };
+	const int nrChunks{ (nrBatches + batchesPerChunk - 1) / batchesPerChunk };
+	std::atomic<int> nrTransformed{ 0 };
+
+	m_pThreadPool->ParallelFor(nrChunks, [&](int chunkIndex)
+		{
+			const int firstBatch{ chunkIndex * batchesPerChunk };
+			const int lastBatch{ std::min(firstBatch + batchesPerChunk, nrBatches) };
+			nrTransformed += transformBatches(firstBatch, lastBatch);
+		});
+
+	m_Statistics.nrVerticesTransformed += nrTransformed;
+}
+
+int RasterizerSoftware::TransformBatch(int batchIndex, std::vector<Vertex_Out>* pVerticesOut)
+{
+	const VertexStreams& streams{ *m_VertexTransform.pVertexStreams };
+	const TransformBatchFunction transformBatch{ m_VertexTransform.pTransformBatch };
+	const int firstVertex{ batchIndex * VERTEX_BATCH_SIZE };
+
+	// transform from mesh position to projection, VERTEX_BATCH_SIZE vertices at a time
+	const float* const pPosition[3]{ &streams.position[0][firstVertex], &streams.position[1][firstVertex], &streams.position[2][firstVertex] };
+
+	alignas(32) float clipPosition[4][VERTEX_BATCH_SIZE]{};
+	float* const pClipPosition[4]{ clipPosition[0], clipPosition[1], clipPosition[2], clipPosition[3] };
+	transformBatch(pPosition, m_VertexTransform.worldViewProjection, true, 4, pClipPosition);
+
+	// transform normals to world space + world position for the view direction
+	alignas(32) float normal[3][VERTEX_BATCH_SIZE]{};
+	alignas(32) float tangent[3][VERTEX_BATCH_SIZE]{};
+	alignas(32) float worldPosition[3][VERTEX_BATCH_SIZE]{};
+	if (!m_VertexTransform.isDepthOnly)
+	{
+		const float* const pNormal[3]{ &streams.normal[0][firstVertex], &streams.normal[1][firstVertex], &streams.normal[2][firstVertex] };
+		const float* const pTangent[3]{ &streams.tangent[0][firstVertex], &streams.tangent[1][firstVertex], &streams.tangent[2][firstVertex] };
+		float* const pNormalOut[4]{ normal[0], normal[1], normal[2], nullptr };
+		float* const pTangentOut[4]{ tangent[0], tangent[1], tangent[2], nullptr };
+		float* const pWorldPosition[4]{ worldPosition[0], worldPosition[1], worldPosition[2], nullptr };
+
+		transformBatch(pNormal, m_VertexTransform.world, false, 3, pNormalOut);
+		transformBatch(pTangent, m_VertexTransform.world, false, 3, pTangentOut);
+		transformBatch(pPosition, m_VertexTransform.world, true, 3, pWorldPosition);
+	}
+
+	// the rest of the pipeline works per vertex
+	const int nrBatchVertices{ std::min(VERTEX_BATCH_SIZE, streams.nrVertices - firstVertex) };
+	for (int lane{}; lane < nrBatchVertices; ++lane)
 	{
-		Vertex_Out transformedVertex{	{currentVertex.position, 1.f}, 
-										currentVertex.color, 
-										currentVertex.uv, 
-										currentVertex.normal, 
-										currentVertex.tangent, 
-										currentVertex.viewDirection };
+		const int vertexIndex{ firstVertex + lane };
+		Vertex_Out& transformedVertex{ (*pVerticesOut)[vertexIndex] };
+		transformedVertex.position = { clipPosition[0][lane], clipPosition[1][lane], clipPosition[2][lane], clipPosition[3][lane] };
 
-		// transform from mesh position to projection
-		transformedVertex.position = worldViewProjectionMatrix.TransformPoint(transformedVertex.position);
+		// clip space position for the clip stage
+		m_ClipPositions[vertexIndex] = transformedVertex.position;
+		m_ClipCodes[vertexIndex] = ComputeClipCode(transformedVertex.position);
 
-		// perspective divide
+		// perspective divide (garbage for w <= 0, those vertices are behind the near plane and get clipped)
 		const float invW{ 1.f / transformedVertex.position.w };
 		transformedVertex.position.x *= invW;
 		transformedVertex.position.y *= invW;
 		transformedVertex.position.z *= invW;
 
-		// transform normals to world space
-		transformedVertex.normal = pWorldMatrix->TransformVector(transformedVertex.normal);
-		transformedVertex.tangent = pWorldMatrix->TransformVector(transformedVertex.tangent);
+		if (m_VertexTransform.isDepthOnly)
+			continue;
+
+		transformedVertex.color = { streams.color[0][vertexIndex], streams.color[1][vertexIndex], streams.color[2][vertexIndex] };
+		transformedVertex.uv = { streams.uv[0][vertexIndex], streams.uv[1][vertexIndex] };
+		transformedVertex.normal = { normal[0][lane], normal[1][lane], normal[2][lane] };
+		transformedVertex.tangent = { tangent[0][lane], tangent[1][lane], tangent[2][lane] };
 
 		// calculate view direction
-		transformedVertex.viewDirection = pWorldMatrix->TransformPoint(currentVertex.position) - camera.origin;
-
-		// add to vertices_out
-		pVerticesOut->emplace_back(transformedVertex);
+		transformedVertex.viewDirection = Vector3{ worldPosition[0][lane], worldPosition[1][lane], worldPosition[2][lane] } - m_VertexTransform.cameraOrigin;
 	}
+
+	m_TransformEpochs[batchIndex] = m_TransformEpoch;
+	return nrBatchVertices;
+}
+
+void RasterizerSoftware::FetchVertex(int vertexIndex, std::vector<Vertex_Out>* pVerticesOut)
+{
+	// batch already transformed for this mesh => reuse, like a post-transform cache that never evicts
+	const int batchIndex{ vertexIndex / VERTEX_BATCH_SIZE };
+	if (m_TransformEpochs[batchIndex] != m_TransformEpoch)
+		m_Statistics.nrVerticesTransformed += TransformBatch(batchIndex, pVerticesOut);
 }
 
-void RasterizerSoftware::RasterizationStage(const DualRasterizerSettings& settings, std::vector<Vertex_Out>* pVerticesOut, std::vector<uint32_t>* pIndices, const PrimitiveTopology& primitiveTopology, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
+void RasterizerSoftware::CullMeshlets(const DualRasterizerSettings& settings, const Camera& camera, const Matrix& worldMatrix, const std::vector<Meshlet>& meshlets, const std::vector<uint32_t>& meshletVertices, const std::vector<uint8_t>& meshletTriangles, int nrVertices)
 {
-	// get screen-space vertices (before in range of frustrum)
-	std::vector<Vector2> verticesScreen{};
-	verticesScreen.reserve(pVerticesOut->size());
+	m_VisibleIndices.clear();
+	m_VisibleVertices.assign(nrVertices, 0);
 
-	for (const auto& currVertex : *pVerticesOut)
+	// frustrum planes in object space, from the columns of the world view projection matrix (inside => dot >= 0)
+	const Matrix worldViewProjectionMatrix{ worldMatrix * camera.viewMatrix * camera.projectionMatrix };
+	const auto getColumn{ [&](int column)
+		{
+			return Vector4{ worldViewProjectionMatrix[0][column], worldViewProjectionMatrix[1][column], worldViewProjectionMatrix[2][column], worldViewProjectionMatrix[3][column] };
+		} };
+	const Vector4 columnX{ getColumn(0) };
+	const Vector4 columnY{ getColumn(1) };
+	const Vector4 columnZ{ getColumn(2) };
+	const Vector4 columnW{ getColumn(3) };
+	const Vector4 frustrumPlanes[6]{ columnZ, columnW - columnZ, columnW + columnX, columnW - columnX, columnW + columnY, columnW - columnY };
+
+	// camera in object space for the normal cones
+	const Vector3 cameraPosition{ Matrix::Inverse(worldMatrix).TransformPoint(camera.origin) };
+
+	for (const Meshlet& meshlet : meshlets)
 	{
-		verticesScreen.emplace_back(Vector2{ (currVertex.position.x + 1) * 0.5f * m_ScreenWidth, (1 - currVertex.position.y) * 0.5f * m_ScreenHeight });
+		++m_Statistics.nrMeshletsTested;
+
+		bool isCulled{ false };
+
+		// bounding sphere completely outside one of the planes
+		for (const Vector4& plane : frustrumPlanes)
+		{
+			const Vector3 planeNormal{ plane.x, plane.y, plane.z };
+			if (Vector3::Dot(planeNormal, meshlet.center) + plane.w < -meshlet.radius * planeNormal.Magnitude())
+			{
+				isCulled = true;
+				break;
+			}
+		}
+
+		// every triangle faces away from the camera (front culling => every triangle faces towards it)
+		if (!isCulled && settings.cullMode != CullMode::None && meshlet.coneCutoff < 1.f)
+		{
+			const Vector3 coneAxis{ settings.cullMode == CullMode::Back ? meshlet.coneAxis : -meshlet.coneAxis };
+			const Vector3 cameraToCenter{ meshlet.center - cameraPosition };
+			isCulled = Vector3::Dot(cameraToCenter, coneAxis) >= meshlet.coneCutoff * cameraToCenter.Magnitude() + meshlet.radius;
+		}
+
+		if (isCulled)
+		{
+			++m_Statistics.nrMeshletsCulled;
+			m_Statistics.nrTrianglesCulled += meshlet.triangleCount;
+			continue;
+		}
+
+		for (uint32_t i{}; i < meshlet.triangleCount * 3; ++i)
+		{
+			const uint32_t vertexIndex{ meshletVertices[meshlet.vertexOffset + meshletTriangles[meshlet.triangleOffset * 3 + i]] };
+			m_VisibleIndices.push_back(vertexIndex);
+			m_VisibleVertices[vertexIndex] = 1;
+		}
 	}
+}
 
+void RasterizerSoftware::RasterizationStage(const DualRasterizerSettings& settings, std::vector<Vertex_Out>* pVerticesOut, std::vector<uint32_t>* pIndices, const PrimitiveTopology& primitiveTopology, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness)
+{
 	int increment{ 1 };
 	if (primitiveTopology == PrimitiveTopology::TriangleList)
 	{
@@ -140,7 +462,13 @@ void RasterizerSoftware::RasterizationStage(const DualRasterizerSettings& settin
 		increment = 1;
 	}
 
-	for (int i{}; i < pIndices->size() - 2; i += increment)
+	// triangle assembly
+	// -------------------------------
+	m_Triangles.clear();
+	m_TriangleSetups.clear();
+
+	// unsigned sizes: i + 2 instead of size - 2 => no wrap around when culling left no indices
+	for (int i{}; i + 2 < static_cast<int>(pIndices->size()); i += increment)
 	{
 		// get indices
 		int modulo{ 0 };	// 0 has no effect on + or -
@@ -152,325 +480,1561 @@ void RasterizerSoftware::RasterizationStage(const DualRasterizerSettings& settin
 		const int index1{ static_cast<int>((*pIndices)[i + 1 + modulo]) };
 		const int index2{ static_cast<int>((*pIndices)[i + 2 - modulo]) };
 
-		// check if valid triangle
-		if (index0 == index1 || index1 == index2 || index2 == index0)
+		// vertices nobody transformed yet (lazy transform) get transformed on first use
+		FetchVertex(index0, pVerticesOut);
+		FetchVertex(index1, pVerticesOut);
+		FetchVertex(index2, pVerticesOut);
+
+		// clipping
+		// -------------------------------
+		const uint32_t clipCode0{ m_ClipCodes[index0] };
+		const uint32_t clipCode1{ m_ClipCodes[index1] };
+		const uint32_t clipCode2{ m_ClipCodes[index2] };
+
+		// all vertices outside the same frustrum plane => can't be visible
+		if (clipCode0 & clipCode1 & clipCode2 & m_FrustrumPlanes)
 			continue;
 
-		//// check cullmode
-		//Vector3 normal{ (*pVerticesOut)[index0].normal + (*pVerticesOut)[index1].normal + (*pVerticesOut)[index2].normal };
-		//normal /= 3;
-		//Vector3 viewDirection{ (*pVerticesOut)[index0].viewDirection + (*pVerticesOut)[index1].viewDirection + (*pVerticesOut)[index2].viewDirection };
-		//viewDirection /= 3;
-		//
-		//const float dotViewAndPlane{ Vector3::Dot(normal, viewDirection) };
-		//if (dotViewAndPlane == 0)
-		//	continue;
-		//
-		//switch (settings.cullMode)
-		//{
-		//case CullMode::Back:
-		//{
-		//	if (dotViewAndPlane > 0)
-		//		continue;
-		//	break;
-		//}
-		//case CullMode::Front:
-		//{
-		//	if (dotViewAndPlane < 0)
-		//		continue;
-		//	break;
-		//}
-		//// case no culling: do nothing
-		//}
-
-		// get positions
-		const Vector4 vertexPos0{ (*pVerticesOut)[index0].position };
-		const Vector4 vertexPos1{ (*pVerticesOut)[index1].position };
-		const Vector4 vertexPos2{ (*pVerticesOut)[index2].position };
-
-		// frustrum culling => if not inside frustrum => skip this triangle
-		if (!IsInsideFrustrum(vertexPos0) ||
-			!IsInsideFrustrum(vertexPos1) ||
-			!IsInsideFrustrum(vertexPos2))
+		// inside near, far and the guard band => no clipping, the bounding box clamp takes care of the screen edges
+		const uint32_t clipPlanes{ (clipCode0 | clipCode1 | clipCode2) & m_ClipPlanes };
+		if (!clipPlanes)
+		{
+			SetupTriangle(settings, index0, index1, index2, pVerticesOut);
 			continue;
+		}
+
+		int polygon[m_MaxClippedVertices]{};
+		const int nrPolygonVertices{ ClipTriangle(index0, index1, index2, clipPlanes, pVerticesOut, polygon) };
+		++m_Statistics.nrTrianglesClipped;
+
+		// clipped polygon is convex => fan, same winding as the original triangle
+		for (int polygonIndex{ 1 }; polygonIndex < nrPolygonVertices - 1; ++polygonIndex)
+			SetupTriangle(settings, polygon[0], polygon[polygonIndex], polygon[polygonIndex + 1], pVerticesOut);
+	}
+
+	// rasterization
+	// -------------------------------
+	const PixelPipeline pixelPipeline{ SelectPixelPipeline(settings) };
+
+	if (!settings.useTileBinning)
+	{
+		for (int triangleIndex{}; triangleIndex < static_cast<int>(m_Triangles.size()); ++triangleIndex)
+		{
+			// the tiles the triangle can read or write
+			const Triangle& triangle{ m_Triangles[triangleIndex] };
+			if (m_UseLazyClear && triangle.minX < triangle.maxX && triangle.minY < triangle.maxY)
+			{
+				for (int tileY{ triangle.minY / m_TileSize }; tileY <= (triangle.maxY - 1) / m_TileSize; ++tileY)
+				{
+					for (int tileX{ triangle.minX / m_TileSize }; tileX <= (triangle.maxX - 1) / m_TileSize; ++tileX)
+						TouchTile(tileX + tileY * m_NrTilesX, m_Statistics);
+				}
+			}
 
-		// vertices
-		const Vector2 vertex0{ verticesScreen[index0].x, verticesScreen[index0].y };
-		const Vector2 vertex1{ verticesScreen[index1].x, verticesScreen[index1].y };
-		const Vector2 vertex2{ verticesScreen[index2].x, verticesScreen[index2].y };
+			(this->*pixelPipeline.pRasterize)(settings, triangleIndex, 0, 0, m_ScreenWidth, m_ScreenHeight, m_Statistics, pDiffuse, pNormal, pSpecular, pGlossiness);
+		}
 
-		// edges
-		const Vector2 edge10{ vertex1 - vertex0 };
-		const Vector2 edge21{ vertex2 - vertex1 };
-		const Vector2 edge02{ vertex0 - vertex2 };
+		if (pixelPipeline.pResolve)
+			(this->*pixelPipeline.pResolve)(0, 0, m_ScreenWidth, m_ScreenHeight, m_Statistics, pDiffuse, pNormal, pSpecular, pGlossiness);
+		return;
+	}
 
-		const float triangleArea{ Vector2::Cross({ vertex2 - vertex0 }, edge10) };
-		const float inversTriangleArea{ 1 / triangleArea };
+	// bin triangles into every tile their bounding box overlaps
+	// in submission order => each pixel sees the same triangles in the same order as the single-threaded path
+	for (std::vector<int>& bin : m_TileBins)
+		bin.clear();
 
-		// bounding box																	// + 1 to correct rounding down to int
-		int maxX{ std::max(static_cast<int>(vertex0.x), std::max(static_cast<int>(vertex1.x), static_cast<int>(vertex2.x))) + 1 };
-		int minX{ std::min(static_cast<int>(vertex0.x), std::min(static_cast<int>(vertex1.x), static_cast<int>(vertex2.x))) };
-		int maxY{ std::max(static_cast<int>(vertex0.y), std::max(static_cast<int>(vertex1.y), static_cast<int>(vertex2.y))) + 1 };
-		int minY{ std::min(static_cast<int>(vertex0.y), std::min(static_cast<int>(vertex1.y), static_cast<int>(vertex2.y))) };
+	for (int triangleIndex{}; triangleIndex < static_cast<int>(m_Triangles.size()); ++triangleIndex)
+	{
+		const Triangle& triangle{ m_Triangles[triangleIndex] };
+		if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+			continue;
 
-		if (maxX > m_ScreenWidth) maxX = m_ScreenWidth;
-		if (minX < 0) minX = 0;
-		if (maxY > m_ScreenHeight) maxY = m_ScreenHeight;
-		if (minY < 0) minY = 0;
+		const int minTileX{ triangle.minX / m_TileSize };
+		const int maxTileX{ (triangle.maxX - 1) / m_TileSize };
+		const int minTileY{ triangle.minY / m_TileSize };
+		const int maxTileY{ (triangle.maxY - 1) / m_TileSize };
 
-		// for each pixel in bounding box
-		// -------------------------------
-		for (int px{ minX }; px <= maxX; ++px)
+		for (int tileY{ minTileY }; tileY <= maxTileY; ++tileY)
 		{
-			for (int py{ minY }; py < maxY; ++py)
+			for (int tileX{ minTileX }; tileX <= maxTileX; ++tileX)
 			{
-				const int pixelIndex{ px + py * m_ScreenWidth };
+				m_TileBins[tileX + tileY * m_NrTilesX].push_back(triangleIndex);
+			}
+		}
+	}
 
-				if (settings.showBoundingBox)
-				{
-					m_pBackBufferPixels[pixelIndex] = SDL_MapRGB(m_pBackBuffer->format,
-						static_cast<uint8_t>(255),
-						static_cast<uint8_t>(255),
-						static_cast<uint8_t>(255));
-					continue;
-				}
-			
-				const Vector2 currentPixel{ static_cast<float>(px), static_cast<float>(py) };
+	// tiles don't share pixels => rasterize and shade them independently
+	m_pThreadPool->ParallelFor(static_cast<int>(m_TileBins.size()), [&](int tileIndex)
+		{
+			const int tileMinX{ (tileIndex % m_NrTilesX) * m_TileSize };
+			const int tileMinY{ (tileIndex / m_NrTilesX) * m_TileSize };
+			const int tileMaxX{ std::min(tileMinX + m_TileSize, m_ScreenWidth) };
+			const int tileMaxY{ std::min(tileMinY + m_TileSize, m_ScreenHeight) };
 
-				// vectors to pixel
-				const Vector2 v0toPixel{ vertex0 - currentPixel };
-				const Vector2 v1toPixel{ vertex1 - currentPixel };
-				const Vector2 v2toPixel{ vertex2 - currentPixel };
+			// every tile counts into its own statistics => no sharing between threads
+			Statistics& tileStatistics{ m_TileStatistics[tileIndex] };
+			tileStatistics = {};
 
-				// cross products
-				const float crossEdge10{ Vector2::Cross(edge10, v0toPixel) };
-				const float crossEdge21{ Vector2::Cross(edge21, v1toPixel) };
-				const float crossEdge02{ Vector2::Cross(edge02, v2toPixel) };
+			// only this task touches the tile => clearing it here is safe
+			if (m_UseLazyClear && !m_TileBins[tileIndex].empty())
+				TouchTile(tileIndex, tileStatistics);
 
-				// if not in triangle
-				switch (settings.cullMode)
-				{
-				case CullMode::Back:
-				{
-					// return if pixel does not hit or hits from the back side 
-					if (crossEdge10 > 0 || crossEdge21 > 0 || crossEdge02 > 0)
-						continue;
-					break;
-				}
-				case CullMode::Front:
-				{
-					// return if pixel does not hit or hits from the front side
-					if (crossEdge10 < 0 || crossEdge21 < 0 || crossEdge02 < 0)
-						continue;
-					break;
-				}
-				case CullMode::None:
-				{
-					// return if pixel hits on the edge
-					if (!(crossEdge10 > 0 && crossEdge21 > 0 && crossEdge02 > 0) && !(crossEdge10 < 0 && crossEdge21 < 0 && crossEdge02 < 0))
-						continue;
-					break;
-				}
-				}
+			for (const int triangleIndex : m_TileBins[tileIndex])
+			{
+				(this->*pixelPipeline.pRasterize)(settings, triangleIndex, tileMinX, tileMinY, tileMaxX, tileMaxY, tileStatistics, pDiffuse, pNormal, pSpecular, pGlossiness);
+			}
+
+			// the tile has seen all its triangles => its visibility is final and can be shaded right away
+			if (pixelPipeline.pResolve)
+				(this->*pixelPipeline.pResolve)(tileMinX, tileMinY, tileMaxX, tileMaxY, tileStatistics, pDiffuse, pNormal, pSpecular, pGlossiness);
+		});
 
-				// pixel is in triangle
-				// -------------------------
+	for (const Statistics& tileStatistics : m_TileStatistics)
+		m_Statistics += tileStatistics;
+}
 
-				// weights
-				const float weight0{ crossEdge21 / triangleArea };
-				const float weight1{ crossEdge02 / triangleArea };
-				const float weight2{ crossEdge10 / triangleArea };
+void RasterizerSoftware::SetupTriangle(const DualRasterizerSettings& settings, int index0, int index1, int index2, std::vector<Vertex_Out>* pVerticesOut)
+{
+	int setupIndex1{ index1 };
+	int setupIndex2{ index2 };
+
+	// screen space
+	const Vector2 vertexScreen0{ ToScreenSpace((*pVerticesOut)[index0].position) };
+	const Vector2 vertexScreen1{ ToScreenSpace((*pVerticesOut)[index1].position) };
+	const Vector2 vertexScreen2{ ToScreenSpace((*pVerticesOut)[index2].position) };
+
+	// vertices in 28.4 fixed point
+	const int64_t x0{ ToFixedPoint(vertexScreen0.x) };
+	const int64_t y0{ ToFixedPoint(vertexScreen0.y) };
+	int64_t x1{ ToFixedPoint(vertexScreen1.x) };
+	int64_t y1{ ToFixedPoint(vertexScreen1.y) };
+	int64_t x2{ ToFixedPoint(vertexScreen2.x) };
+	int64_t y2{ ToFixedPoint(vertexScreen2.y) };
+
+	// twice the signed area, positive => front facing
+	int64_t doubleArea{ (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0) };
+
+	// degenerate (after snapping) => never covers a pixel center
+	if (doubleArea == 0)
+		return;
 
-				// depth (using z values for frustrum clipping)
-				const float inverseZ0{ 1.f / vertexPos0.z };
-				const float inverseZ1{ 1.f / vertexPos1.z };
-				const float inverseZ2{ 1.f / vertexPos2.z };
+	// check cullmode
+	if (settings.cullMode == CullMode::Back && doubleArea < 0)
+		return;
+	if (settings.cullMode == CullMode::Front && doubleArea > 0)
+		return;
 
-				const float depth{ 1.f / (inverseZ0 * weight0 +
-											inverseZ1 * weight1 +
-											inverseZ2 * weight2) };
+	// back facing but not culled => swap two vertices so the inside is always positive
+	if (doubleArea < 0)
+	{
+		std::swap(setupIndex1, setupIndex2);
+		std::swap(x1, x2);
+		std::swap(y1, y2);
+		doubleArea = -doubleArea;
+	}
 
-				// if further than previous rendered pixel 
-				//		=> skip this pixel
-				if (depth >= m_pDepthBufferPixels[pixelIndex])
-					continue;
+	Triangle triangle{ index0, setupIndex1, setupIndex2 };
 
-				// store new depth
-				m_pDepthBufferPixels[pixelIndex] = depth;
+	// edge i is the edge opposite of vertex i
+	int64_t edgeBias[3]{};
+	const int64_t edgeStartX[3]{ x1, x2, x0 };
+	const int64_t edgeStartY[3]{ y1, y2, y0 };
+	const int64_t edgeEndX[3]{ x2, x0, x1 };
+	const int64_t edgeEndY[3]{ y2, y0, y1 };
 
-				ColorRGB finalColor{};
+	for (int edge{}; edge < 3; ++edge)
+	{
+		const int64_t deltaX{ edgeEndX[edge] - edgeStartX[edge] };
+		const int64_t deltaY{ edgeEndY[edge] - edgeStartY[edge] };
+
+		// top-left fill rule: pixel centers exactly on an edge only belong to the triangle if it is a top or left edge
+		// (y points down => left edges go up, top edges are horizontal and go right)
+		const bool isTopLeft{ deltaY < 0 || (deltaY == 0 && deltaX > 0) };
+		edgeBias[edge] = isTopLeft ? 0 : -1;
+
+		// edge function evaluated at the center of pixel (0, 0), stepping one pixel at a time
+		const int64_t halfPixel{ m_SubPixelScale / 2 };
+		triangle.edgeOrigin[edge] = deltaX * (halfPixel - edgeStartY[edge]) - deltaY * (halfPixel - edgeStartX[edge]) + edgeBias[edge];
+		triangle.edgeStepX[edge] = -deltaY * m_SubPixelScale;
+		triangle.edgeStepY[edge] = deltaX * m_SubPixelScale;
+	}
 
-				// Color
-				if (settings.showDepthBuffer)
-				{
-					const float remappedDepth{ Remap(depth, 0.990f, 1.f) };
-					finalColor = { remappedDepth, remappedDepth, remappedDepth };
-				}
-				else
-				{
-					// get uv(using w values and viewSpaceDepth for linear interpolation)
-					const float inverseW0{ 1.f / vertexPos0.w };
-					const float inverseW1{ 1.f / vertexPos1.w };
-					const float inverseW2{ 1.f / vertexPos2.w };
-
-					const float viewSpaceDepth{ 1.f / (inverseW0 * weight0 +
-														inverseW1 * weight1 +
-														inverseW2 * weight2) };
-
-					const Vertex_Out vertexOut0{ (*pVerticesOut)[index0] };
-					const Vertex_Out vertexOut1{ (*pVerticesOut)[index1] };
-					const Vertex_Out vertexOut2{ (*pVerticesOut)[index2] };
-
-					const Vector2 interpPosXY{ (vertexOut0.position.GetXY() * weight0) +
-												(vertexOut1.position.GetXY() * weight1) +
-												(vertexOut2.position.GetXY() * weight2) };
-
-					const ColorRGB interpColor{ ((vertexOut0.color * inverseW0 * weight0) +
-												 (vertexOut1.color * inverseW1 * weight1) +
-												 (vertexOut2.color * inverseW2 * weight2)) * viewSpaceDepth };
-
-					const Vector2 interpUV{ ((vertexOut0.uv * inverseW0 * weight0) +
-											 (vertexOut1.uv * inverseW1 * weight1) +
-											 (vertexOut2.uv * inverseW2 * weight2)) * viewSpaceDepth };
-
-					const Vector3 interpNormal{ (((vertexOut0.normal * inverseW0 * weight0) +
-												  (vertexOut1.normal * inverseW1 * weight1) +
-												  (vertexOut2.normal * inverseW2 * weight2)) * viewSpaceDepth).Normalized() };
-
-					const Vector3 interpTangent{ (((vertexOut0.tangent * inverseW0 * weight0) +
-												   (vertexOut1.tangent * inverseW1 * weight1) +
-												   (vertexOut2.tangent * inverseW2 * weight2)) * viewSpaceDepth).Normalized() };
-
-					const Vector3 interpViewDirection{ (((vertexOut0.viewDirection * inverseW0 * weight0) +
-														 (vertexOut1.viewDirection * inverseW1 * weight1) +
-														 (vertexOut2.viewDirection * inverseW2 * weight2)) * viewSpaceDepth).Normalized() };
-
-					Vertex_Out shadeInfo{ Vector4 {interpPosXY.x, interpPosXY.y, depth, viewSpaceDepth},
-											interpColor,
-											interpUV,
-											interpNormal,
-											interpTangent,
-											interpViewDirection };
-
-					// Shade
-					finalColor = PixelShadingStage(settings, shadeInfo, pDiffuse, pNormal, pSpecular, pGlossiness);
-				}
+	// bounding box																	// + 1 to correct rounding down to int
+	triangle.maxX = static_cast<int>(std::max(x0, std::max(x1, x2)) >> m_SubPixelBits) + 1;
+	triangle.minX = static_cast<int>(std::min(x0, std::min(x1, x2)) >> m_SubPixelBits);
+	triangle.maxY = static_cast<int>(std::max(y0, std::max(y1, y2)) >> m_SubPixelBits) + 1;
+	triangle.minY = static_cast<int>(std::min(y0, std::min(y1, y2)) >> m_SubPixelBits);
+
+	if (triangle.maxX > m_ScreenWidth) triangle.maxX = m_ScreenWidth;
+	if (triangle.minX < 0) triangle.minX = 0;
+	if (triangle.maxY > m_ScreenHeight) triangle.maxY = m_ScreenHeight;
+	if (triangle.minY < 0) triangle.minY = 0;
 
-				//Update Color in Buffer
-				finalColor.MaxToOne();
+	// edge offsets of the pixels in a span
+	for (int edge{}; edge < 3; ++edge)
+	{
+		for (int lane{}; lane < SPAN_WIDTH; ++lane)
+			triangle.span.edgeLaneOffset[edge][lane] = triangle.edgeStepX[edge] * lane;
+	}
+
+	// edge functions (without fill rule bias) at the center of the top left pixel of the bounding box
+	// => every plane below is relative to that pixel, weight of vertex i = edge i / double area
+	double edgeAtMin[3]{};
+	for (int edge{}; edge < 3; ++edge)
+		edgeAtMin[edge] = static_cast<double>(triangle.edgeOrigin[edge] - edgeBias[edge] + triangle.edgeStepX[edge] * triangle.minX + triangle.edgeStepY[edge] * triangle.minY);
+	const double inverseDoubleArea{ 1.0 / static_cast<double>(doubleArea) };
+
+	// depth plane: ndc depth is linear in screen space => weights * z
+	const Vertex_Out* pTriangleVertices[3]{ &(*pVerticesOut)[triangle.index0], &(*pVerticesOut)[triangle.index1], &(*pVerticesOut)[triangle.index2] };
+	const float vertexDepth[3]{ pTriangleVertices[0]->position.z, pTriangleVertices[1]->position.z, pTriangleVertices[2]->position.z };
+	double depthAtMin{};
+	double depthStepX{};
+	double depthStepY{};
+	for (int edge{}; edge < 3; ++edge)
+	{
+		depthAtMin += static_cast<double>(vertexDepth[edge]) * edgeAtMin[edge];
+		depthStepX += static_cast<double>(vertexDepth[edge]) * static_cast<double>(triangle.edgeStepX[edge]);
+		depthStepY += static_cast<double>(vertexDepth[edge]) * static_cast<double>(triangle.edgeStepY[edge]);
+	}
+	triangle.depthAtMin = static_cast<float>(depthAtMin * inverseDoubleArea);
+	triangle.span.depthStepX = static_cast<float>(depthStepX * inverseDoubleArea);
+	triangle.depthStepY = static_cast<float>(depthStepY * inverseDoubleArea);
+
+	// attribute planes: attribute / w is linear in screen space => weights * attribute / w
+	TriangleSetup setup{};
+	setup.minX = triangle.minX;
+	setup.minY = triangle.minY;
 
-				m_pBackBufferPixels[pixelIndex] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255));
+	// depth only => the attributes are never read (and weren't transformed)
+	if (!settings.showDepthBuffer)
+	{
+		double attributeAtMin[TriangleSetup::NrAttributes]{};
+		double attributeStepX[TriangleSetup::NrAttributes]{};
+		double attributeStepY[TriangleSetup::NrAttributes]{};
+		for (int edge{}; edge < 3; ++edge)
+		{
+			const Vertex_Out& vertex{ *pTriangleVertices[edge] };
+			const float inverseW{ 1.f / vertex.position.w };
+			const float attributes[TriangleSetup::NrAttributes]{ 1.f,
+				vertex.color.r, vertex.color.g, vertex.color.b,
+				vertex.uv.x, vertex.uv.y,
+				vertex.normal.x, vertex.normal.y, vertex.normal.z,
+				vertex.tangent.x, vertex.tangent.y, vertex.tangent.z,
+				vertex.viewDirection.x, vertex.viewDirection.y, vertex.viewDirection.z };
+
+			for (int attribute{}; attribute < TriangleSetup::NrAttributes; ++attribute)
+			{
+				const double value{ static_cast<double>(attributes[attribute] * inverseW) };
+				attributeAtMin[attribute] += value * edgeAtMin[edge];
+				attributeStepX[attribute] += value * static_cast<double>(triangle.edgeStepX[edge]);
+				attributeStepY[attribute] += value * static_cast<double>(triangle.edgeStepY[edge]);
 			}
 		}
+
+		for (int attribute{}; attribute < TriangleSetup::NrAttributes; ++attribute)
+		{
+			setup.atMin[attribute] = static_cast<float>(attributeAtMin[attribute] * inverseDoubleArea);
+			setup.stepX[attribute] = static_cast<float>(attributeStepX[attribute] * inverseDoubleArea);
+			setup.stepY[attribute] = static_cast<float>(attributeStepY[attribute] * inverseDoubleArea);
+		}
 	}
+
+	// closest depth of the triangle for the hierarchical z test
+	// pulled a bit closer so float rounding of the depth plane can never make a visible pixel fail the test
+	triangle.minDepth = std::min(vertexDepth[0], std::min(vertexDepth[1], vertexDepth[2])) - m_HiZDepthMargin;
+
+	m_Triangles.emplace_back(triangle);
+	m_TriangleSetups.emplace_back(setup);
 }
 
-bool RasterizerSoftware::IsInsideFrustrum(const Vector4& vertex) const
+int RasterizerSoftware::ClipTriangle(int index0, int index1, int index2, uint32_t clipPlanes, std::vector<Vertex_Out>* pVerticesOut, int* pPolygon)
 {
-	// x should be between -1 and 1
-	if (vertex.x < -1 || vertex.x > 1)
-		return false;
+	// sutherland-hodgman in homogeneous clip space, one plane at a time
+	int polygon[m_MaxClippedVertices]{ index0, index1, index2 };
+	int nrVertices{ 3 };
+
+	for (int plane{}; plane < NrClipPlanes; ++plane)
+	{
+		if (!(clipPlanes & (1u << plane)))
+			continue;
+
+		int clippedPolygon[m_MaxClippedVertices]{};
+		int nrClippedVertices{};
+
+		for (int i{}; i < nrVertices; ++i)
+		{
+			const int currentIndex{ polygon[i] };
+			const int nextIndex{ polygon[(i + 1) % nrVertices] };
+			const float currentDistance{ GetClipDistance(m_ClipPositions[currentIndex], plane) };
+			const float nextDistance{ GetClipDistance(m_ClipPositions[nextIndex], plane) };
+
+			if (currentDistance >= 0.f)
+				clippedPolygon[nrClippedVertices++] = currentIndex;
+
+			// edge crosses the plane => new vertex on the plane
+			if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+			{
+				const float factor{ currentDistance / (currentDistance - nextDistance) };
+				clippedPolygon[nrClippedVertices++] = AddClippedVertex(currentIndex, nextIndex, factor, pVerticesOut);
+			}
+		}
 
-	// y should be between -1 and 1
-	if (vertex.y < -1 || vertex.y > 1)
-		return false;
+		// fully clipped away
+		if (nrClippedVertices < 3)
+			return 0;
 
-	// z should be between 0 and 1
-	if (vertex.z < 0 || vertex.z > 1)
-		return false;
+		std::copy_n(clippedPolygon, nrClippedVertices, polygon);
+		nrVertices = nrClippedVertices;
+	}
 
-	// inside frustrum
-	return true;
+	std::copy_n(polygon, nrVertices, pPolygon);
+	return nrVertices;
 }
 
-float RasterizerSoftware::Remap(float value, float min, float max) const
+int RasterizerSoftware::AddClippedVertex(int index0, int index1, float factor, std::vector<Vertex_Out>* pVerticesOut)
 {
-	if (value <= min)
-		return 0;
-	if (value >= max)
-		return 1;
-
-	value = (value - min) / (max - min);
-	return value;
+	// everything is still linear in clip space => plain lerp, perspective divide afterwards
+	const Vector4 clipPosition0{ m_ClipPositions[index0] };
+	const Vector4 clipPosition1{ m_ClipPositions[index1] };
+	const Vector4 clipPosition{ clipPosition0 + (clipPosition1 - clipPosition0) * factor };
+
+	const Vertex_Out vertex0{ (*pVerticesOut)[index0] };
+	const Vertex_Out vertex1{ (*pVerticesOut)[index1] };
+
+	Vertex_Out clippedVertex{ clipPosition,
+								ColorRGB::Lerp(vertex0.color, vertex1.color, factor),
+								vertex0.uv + (vertex1.uv - vertex0.uv) * factor,
+								vertex0.normal + (vertex1.normal - vertex0.normal) * factor,
+								vertex0.tangent + (vertex1.tangent - vertex0.tangent) * factor,
+								vertex0.viewDirection + (vertex1.viewDirection - vertex0.viewDirection) * factor };
+
+	// perspective divide
+	const float invW{ 1.f / clipPosition.w };
+	clippedVertex.position.x *= invW;
+	clippedVertex.position.y *= invW;
+	clippedVertex.position.z *= invW;
+
+	pVerticesOut->emplace_back(clippedVertex);
+	m_ClipPositions.emplace_back(clipPosition);
+	m_ClipCodes.emplace_back(ComputeClipCode(clipPosition));
+
+	return static_cast<int>(pVerticesOut->size()) - 1;
 }
 
-ColorRGB RasterizerSoftware::PixelShadingStage(const DualRasterizerSettings& settings, const Vertex_Out shadeInfo, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
+template<typename Config>
+void RasterizerSoftware::RasterizeTriangle(const DualRasterizerSettings& settings, int triangleIndex, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY, Statistics& statistics, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
 {
-	// normal maps
-	Vector3 sampledNormal{ shadeInfo.normal };
+	const Triangle& triangle{ m_Triangles[triangleIndex] };
 
-	if (settings.cullMode == CullMode::Front)
-		sampledNormal = -sampledNormal;
+	// bounding box, clipped to the region being rasterized (screen or tile)
+	const int minX{ std::max(triangle.minX, clipMinX) };
+	const int maxX{ std::min(triangle.maxX, clipMaxX) };
+	const int minY{ std::max(triangle.minY, clipMinY) };
+	const int maxY{ std::min(triangle.maxY, clipMaxY) };
 
-	if (settings.useNormalMap)
+	// bounding box visualization => no coverage or depth test
+	if constexpr (Config::Output == PixelOutput::BoundingBox)
 	{
-		const Vector3 binormal{ Vector3::Cross(sampledNormal, shadeInfo.tangent) };
-		const Matrix tangentSpace{ Matrix{shadeInfo.tangent, binormal, sampledNormal, Vector3::Zero} };
+		if (m_ColorTarget != ColorTarget::Direct)
+			FillColorRect(m_pColorTargetPixels, minX, minY, maxX, maxY, ColorRGB{ 1.f, 1.f, 1.f });
+		else
+			FillColorRect(m_pRenderPixels, minX, minY, maxX, maxY, m_PixelPacking.Pack(255, 255, 255));
+		return;
+	}
 
-		const ColorRGB normalSampleColor{ pNormal->Sample(shadeInfo.uv) };
-		sampledNormal = Vector3{ normalSampleColor.r, normalSampleColor.g, normalSampleColor.b };
-		sampledNormal = 2.f * sampledNormal - Vector3{ 1, 1, 1 }; // from range [0, 1] to [-1, 1]
+	if (minX >= maxX || minY >= maxY)
+		return;
 
-		sampledNormal = tangentSpace.TransformVector(sampledNormal);
-	}
+	const CoverageDepthFunction coverageDepth{ settings.useSimd ? m_pCoverageDepthSIMD : m_pCoverageDepthScalar };
+	const CoverageDepthUnorm24Function coverageDepthUnorm24{ settings.useSimd ? m_pCoverageDepthUnorm24SIMD : m_pCoverageDepthUnorm24Scalar };
+	const CoverageDepthUnorm16Function coverageDepthUnorm16{ settings.useSimd ? m_pCoverageDepthUnorm16SIMD : m_pCoverageDepthUnorm16Scalar };
+	const int spanDepthBytes{ SPAN_WIDTH * GetDepthBytesPerPixel() };
+	const PackColorsFunction packColors{ settings.useSimd ? m_pPackColorsSIMD : m_pPackColorsScalar };
 
-	// observed area
-	const float dotProduct{ std::max(Vector3::Dot(sampledNormal, -m_LightDirection), 0.f) };
-	const ColorRGB observedArea = { dotProduct, dotProduct, dotProduct };
+	// hierarchical z blocks the bounding box overlaps
+	const int minBlockX{ minX / m_HiZBlockSize };
+	const int maxBlockX{ (maxX - 1) / m_HiZBlockSize };
+	const int minBlockY{ minY / m_HiZBlockSize };
+	const int maxBlockY{ (maxY - 1) / m_HiZBlockSize };
 
-	switch (settings.shadingMode)
-	{
-	case ShadingMode::ObservedArea:
-	{
-		return observedArea;
-	}
-	case ShadingMode::Diffuse:
+	++statistics.nrTrianglesTested;
+	if (settings.useHiZ)
 	{
-		// lambert diffuse
-		const float reflection{ 1.f };
-		const ColorRGB lambert{ pDiffuse->Sample(shadeInfo.uv) * reflection / PI };
-		return lambert * m_LightIntensity * observedArea;
+		// closest point of the triangle is behind everything in its blocks => reject before any per pixel work
+		float regionMaxDepth{};
+		for (int blockY{ minBlockY }; blockY <= maxBlockY; ++blockY)
+		{
+			for (int blockX{ minBlockX }; blockX <= maxBlockX; ++blockX)
+				regionMaxDepth = std::max(regionMaxDepth, m_pHiZ[blockX + blockY * m_HiZWidth]);
+		}
+
+		if (triangle.minDepth >= regionMaxDepth)
+		{
+			++statistics.nrTrianglesRejected;
+			return;
+		}
 	}
-	case ShadingMode::Specular:
-	{
-		// phong
-		const float specularReflection{ 1.f };
-		const float shininess{ 25.f };
-		const ColorRGB specularColor{ pSpecular->Sample(shadeInfo.uv) };
-		const float glossiness{ pGlossiness->Sample(shadeInfo.uv).r * shininess };	// grayscale map
 
-		const Vector3 reflect{ Vector3::Reflect(m_LightDirection, sampledNormal) };
-		const float cosAngle{ std::max(Vector3::Dot(reflect, -shadeInfo.viewDirection), 0.f) };
-		const float phongValue{ specularReflection * powf(cosAngle, glossiness) };
-		ColorRGB phong{ phongValue, phongValue, phongValue };
-		phong *= specularColor;
+	float spanDepth[SPAN_WIDTH]{};
+	ColorRGB spanColors[SPAN_WIDTH]{};	// shaded one pixel at a time, written to the back buffer as a span
 
-		return phong * observedArea;
-	}
-	case ShadingMode::Combined:
+	// for each block of pixels in bounding box
+	// -------------------------------
+	for (int blockY{ minBlockY }; blockY <= maxBlockY; ++blockY)
 	{
-		// lambert diffuse
-		const float reflection{ 1.f };
-		const ColorRGB lambert{ pDiffuse->Sample(shadeInfo.uv) * reflection / PI };
+		const int blockMinY{ std::max(blockY * m_HiZBlockSize, minY) };
+		const int blockMaxY{ std::min((blockY + 1) * m_HiZBlockSize, maxY) };
 
-		// phong
-		const float specularReflection{ 1.f };
-		const float shininess{ 25.f };
-		const ColorRGB specularColor{ pSpecular->Sample(shadeInfo.uv) };
-		const float glossiness{ pGlossiness->Sample(shadeInfo.uv).r * shininess };	// grayscale map
+		for (int blockX{ minBlockX }; blockX <= maxBlockX; ++blockX)
+		{
+			float& blockMaxDepth{ m_pHiZ[blockX + blockY * m_HiZWidth] };
 
-		const Vector3 reflect{ Vector3::Reflect(m_LightDirection, sampledNormal) };
-		const float cosAngle{ std::max(Vector3::Dot(reflect, -shadeInfo.viewDirection), 0.f) };
-		const float phongValue{ specularReflection * powf(cosAngle, glossiness) };
-		ColorRGB phong{ phongValue, phongValue, phongValue };
-		phong *= specularColor;
+			++statistics.nrBlocksTested;
+			if (settings.useHiZ && triangle.minDepth >= blockMaxDepth)
+			{
+				++statistics.nrBlocksRejected;
+				continue;
+			}
 
-		const ColorRGB ambient{ 0.025f, 0.025f, 0.025f };
-		return observedArea * (lambert * m_LightIntensity + phong + ambient);
-	}
-	}
-}
+			// a row of a block is exactly one span, spans start at multiples of SPAN_WIDTH
+			// => same spans (and depth values) whichever tile is being rasterized
+			const int spanX{ blockX * m_HiZBlockSize };
+
+			// pixels of the span inside the bounding box
+			const int firstLane{ std::max(minX - spanX, 0) };
+			const int lastLane{ std::min(maxX - spanX, SPAN_WIDTH) };
+			const uint32_t validMask{ ((1u << lastLane) - 1) & ~((1u << firstLane) - 1) };
+
+			// edge functions at the first pixel center, from here on only integer adds
+			int64_t edge[3]{};
+			for (int i{}; i < 3; ++i)
+				edge[i] = triangle.edgeOrigin[i] + triangle.edgeStepX[i] * spanX + triangle.edgeStepY[i] * blockMinY;
+
+			bool hasDepthWrites{ false };
+
+			// plane compressed => the block is expanded to a local copy for this triangle and compressed again afterwards
+			DepthBlock* pDepthBlock{ nullptr };
+			float blockDepth[m_HiZBlockSize * m_HiZBlockSize];
+			uint64_t writtenPixels{};
+			if (m_DepthFormat == DepthFormat::PlaneCompressed && !m_pDepthBlocks[blockX + blockY * m_HiZWidth].isExpanded)
+			{
+				pDepthBlock = &m_pDepthBlocks[blockX + blockY * m_HiZWidth];
+				ExpandDepthBlock(*pDepthBlock, blockX, blockY, blockDepth);
+				statistics.nrDepthBytes += sizeof(DepthBlock);
+			}
+
+			for (int py{ blockMinY }; py < blockMaxY; ++py)
+			{
+				const int depthIndex{ GetDepthIndex(spanX, py) };
+				const float rowDepth{ triangle.depthAtMin + triangle.depthStepY * static_cast<float>(py - triangle.minY) };
+				const float firstDepth{ rowDepth + triangle.span.depthStepX * static_cast<float>(spanX - triangle.minX) };
+
+				// coverage + depth test + depth write for the whole span
+				uint32_t mask{};
+				if (pDepthBlock)
+				{
+					const int blockRow{ py - blockY * m_HiZBlockSize };
+					mask = coverageDepth(triangle.span, edge, validMask, firstDepth, blockDepth + blockRow * m_HiZBlockSize, spanDepth);
+					writtenPixels |= static_cast<uint64_t>(mask) << (blockRow * m_HiZBlockSize);
+				}
+				else
+				{
+					switch (m_DepthFormat)
+					{
+					case DepthFormat::Unorm24:
+						mask = coverageDepthUnorm24(triangle.span, edge, validMask, firstDepth, m_pDepthBufferUnorm24 + depthIndex, spanDepth);
+						break;
+					case DepthFormat::Unorm16:
+						mask = coverageDepthUnorm16(triangle.span, edge, validMask, firstDepth, m_pDepthBufferUnorm16 + depthIndex, spanDepth);
+						break;
+					default:
+						mask = coverageDepth(triangle.span, edge, validMask, firstDepth, m_pDepthBufferPixels + depthIndex, spanDepth);
+						break;
+					}
+
+					// span read, written back when something passed
+					statistics.nrDepthBytes += mask ? 2 * spanDepthBytes : spanDepthBytes;
+				}
+				hasDepthWrites |= mask != 0;
+
+				// shade the pixels that are in the triangle and closer
+				if constexpr (Config::UsesPackets)
+				{
+					// the whole span at once, the mask keeps the uncovered lanes out
+					if (mask)
+					{
+						ShadePacket<Config>(m_TriangleSetups[triangleIndex], spanX, py, mask, pDiffuse, pNormal, pSpecular, pGlossiness);
+						statistics.nrPixelsShaded += std::popcount(mask);
+					}
+					mask = 0;
+				}
+
+				const uint32_t shadedMask{ mask };
+				while (mask)
+				{
+					const int lane{ std::countr_zero(mask) };
+					mask &= mask - 1;
+
+					const int px{ spanX + lane };
+
+					// deferred => only remember what is visible, shading happens once per pixel in the resolve
+					if constexpr (Config::Output == PixelOutput::TriangleIndex)
+					{
+						m_pVisibilityBuffer[px + py * m_ScreenWidth] = triangleIndex;
+					}
+					else
+					{
+						spanColors[lane] = ShadePixel<Config>(m_TriangleSetups[triangleIndex], px, py, spanDepth[lane], pDiffuse, pNormal, pSpecular, pGlossiness);
+						++statistics.nrPixelsShaded;
+					}
+				}
 
+				if constexpr (Config::Output != PixelOutput::TriangleIndex)
+				{
+					if (shadedMask)
+						WriteSpan(GetColorIndex(spanX, py), spanColors, shadedMask, packColors);
+				}
+
+				for (int i{}; i < 3; ++i)
+					edge[i] += triangle.edgeStepY[i];
+			}
+
+			// depth writes only bring pixels closer => the max of the block can only have gone down
+			if (hasDepthWrites)
+			{
+				if (pDepthBlock)
+				{
+					const DepthPlane plane{ triangle.depthAtMin, triangle.span.depthStepX, triangle.depthStepY, triangle.minX, triangle.minY };
+					blockMaxDepth = CompressDepthBlock(*pDepthBlock, plane, writtenPixels, blockDepth, blockX, blockY, statistics);
+				}
+				else
+				{
+					blockMaxDepth = ComputeBlockMaxDepth(blockX, blockY);
+					statistics.nrDepthBytes += spanDepthBytes * m_HiZBlockSize;
+				}
+			}
+		}
+	}
+}
+
+float RasterizerSoftware::ComputeBlockMaxDepth(int blockX, int blockY) const
+{
+	const int blockIndex{ GetDepthIndex(blockX * m_HiZBlockSize, blockY * m_HiZBlockSize) };
+	const int rowStride{ GetDepthRowStride() };
+
+	// inverted unorm => the farthest pixel has the smallest value, decoded afterwards
+	// the decoded value is below every depth that would still pass => the hierarchical z stays conservative
+	if (m_DepthFormat == DepthFormat::Unorm24 || m_DepthFormat == DepthFormat::Unorm16)
+	{
+		uint32_t minValue{ UINT32_MAX };
+		for (int y{}; y < m_HiZBlockSize; ++y)
+		{
+			for (int x{}; x < m_HiZBlockSize; ++x)
+			{
+				const int pixelIndex{ blockIndex + x + y * rowStride };
+				minValue = std::min(minValue, m_DepthFormat == DepthFormat::Unorm24 ? m_pDepthBufferUnorm24[pixelIndex] : m_pDepthBufferUnorm16[pixelIndex]);
+			}
+		}
+		return DecodeDepthUnorm(minValue, m_DepthFormat == DepthFormat::Unorm24 ? DepthUnormMax<uint32_t>() : DepthUnormMax<uint16_t>());
+	}
+
+	const float* pBlock{ m_pDepthBufferPixels + blockIndex };
+
+	float maxDepth{};
+	for (int y{}; y < m_HiZBlockSize; ++y)
+	{
+		for (int x{}; x < m_HiZBlockSize; ++x)
+			maxDepth = std::max(maxDepth, pBlock[x + y * rowStride]);
+	}
+	return maxDepth;
+}
+
+void RasterizerSoftware::ClearDepth(int minX, int minY, int maxX, int maxY, Statistics& statistics)
+{
+	// depth buffer coordinates, multiples of m_HiZBlockSize
+	const int minBlockX{ minX / m_HiZBlockSize };
+	const int maxBlockX{ maxX / m_HiZBlockSize };
+	for (int blockY{ minY / m_HiZBlockSize }; blockY < maxY / m_HiZBlockSize; ++blockY)
+		std::fill(m_pHiZ + minBlockX + blockY * m_HiZWidth, m_pHiZ + maxBlockX + blockY * m_HiZWidth, FLT_MAX);
+
+	// plane compressed => only the blocks, expanded ones are back to a single clear plane
+	if (m_DepthFormat == DepthFormat::PlaneCompressed)
+	{
+		for (int blockY{ minY / m_HiZBlockSize }; blockY < maxY / m_HiZBlockSize; ++blockY)
+			std::fill(m_pDepthBlocks + minBlockX + blockY * m_HiZWidth, m_pDepthBlocks + maxBlockX + blockY * m_HiZWidth, DepthBlock{});
+		statistics.nrDepthBytes += static_cast<int64_t>(maxBlockX - minBlockX) * (maxY - minY) / m_HiZBlockSize * sizeof(DepthBlock);
+		return;
+	}
+
+	// row major => one run per row, tiled => the blocks of a block row are one run
+	const int runHeight{ m_UseTiledLayout ? m_HiZBlockSize : 1 };
+	const int runLength{ (maxX - minX) * runHeight };
+	for (int py{ minY }; py < maxY; py += runHeight)
+	{
+		const int runIndex{ GetDepthIndex(minX, py) };
+		switch (m_DepthFormat)
+		{
+		case DepthFormat::Unorm24:
+			std::fill_n(m_pDepthBufferUnorm24 + runIndex, runLength, 0u);
+			break;
+		case DepthFormat::Unorm16:
+			std::fill_n(m_pDepthBufferUnorm16 + runIndex, runLength, static_cast<uint16_t>(0));
+			break;
+		default:
+			std::fill_n(m_pDepthBufferPixels + runIndex, runLength, FLT_MAX);
+			break;
+		}
+	}
+	statistics.nrDepthBytes += static_cast<int64_t>(maxX - minX) * (maxY - minY) * GetDepthBytesPerPixel();
+}
+
+float RasterizerSoftware::ReadDepth(int px, int py) const
+{
+	const int pixelIndex{ GetDepthIndex(px, py) };
+	switch (m_DepthFormat)
+	{
+	case DepthFormat::Unorm24:
+		return DecodeDepthUnorm(m_pDepthBufferUnorm24[pixelIndex], DepthUnormMax<uint32_t>());
+	case DepthFormat::Unorm16:
+		return DecodeDepthUnorm(m_pDepthBufferUnorm16[pixelIndex], DepthUnormMax<uint16_t>());
+	case DepthFormat::PlaneCompressed:
+	{
+		const int blockX{ px / m_HiZBlockSize };
+		const int blockY{ py / m_HiZBlockSize };
+		const DepthBlock& block{ m_pDepthBlocks[blockX + blockY * m_HiZWidth] };
+		if (block.isExpanded)
+			break;
+
+		const int lane{ px - blockX * m_HiZBlockSize };
+		const int bit{ lane + (py - blockY * m_HiZBlockSize) * m_HiZBlockSize };
+		return block.planes[(block.planeSelect >> bit) & 1].Evaluate(blockX * m_HiZBlockSize, py, lane);
+	}
+	default:
+		break;
+	}
+	return m_pDepthBufferPixels[pixelIndex];
+}
+
+int RasterizerSoftware::GetDepthBytesPerPixel() const
+{
+	switch (m_DepthFormat)
+	{
+	case DepthFormat::Unorm16:
+		return sizeof(uint16_t);
+	case DepthFormat::Unorm24:
+		return sizeof(uint32_t);
+	default:
+		return sizeof(float);
+	}
+}
+
+void RasterizerSoftware::ExpandDepthBlock(const DepthBlock& block, int blockX, int blockY, float* pBlockDepth) const
+{
+	// still cleared => no plane to evaluate
+	if (block.planeSelect == 0 && block.planes[0].depthAtMin == FLT_MAX)
+	{
+		std::fill_n(pBlockDepth, m_HiZBlockSize * m_HiZBlockSize, FLT_MAX);
+		return;
+	}
+
+	// DepthPlane::Evaluate with the row part done once per plane
+	const int spanX{ blockX * m_HiZBlockSize };
+	for (int y{}; y < m_HiZBlockSize; ++y)
+	{
+		const int py{ blockY * m_HiZBlockSize + y };
+		float firstDepth[2]{};
+		for (int i{}; i < 2; ++i)
+		{
+			const DepthPlane& plane{ block.planes[i] };
+			const float rowDepth{ plane.depthAtMin + plane.depthStepY * static_cast<float>(py - plane.minY) };
+			firstDepth[i] = rowDepth + plane.depthStepX * static_cast<float>(spanX - plane.minX);
+		}
+
+		const uint32_t rowSelect{ static_cast<uint32_t>(block.planeSelect >> (y * m_HiZBlockSize)) };
+		for (int lane{}; lane < m_HiZBlockSize; ++lane)
+		{
+			const int i{ static_cast<int>((rowSelect >> lane) & 1) };
+			pBlockDepth[lane + y * m_HiZBlockSize] = firstDepth[i] + block.planes[i].depthStepX * static_cast<float>(lane);
+		}
+	}
+}
+
+float RasterizerSoftware::CompressDepthBlock(DepthBlock& block, const DepthPlane& plane, uint64_t writtenPixels, const float* pBlockDepth, int blockX, int blockY, Statistics& statistics) const
+{
+	// pixels the new triangle didn't write keep their old plane
+	const uint64_t oldPlane0Pixels{ ~block.planeSelect & ~writtenPixels };
+	const uint64_t oldPlane1Pixels{ block.planeSelect & ~writtenPixels };
+
+	if (oldPlane0Pixels && oldPlane1Pixels)
+	{
+		// 3 planes => a float per pixel from now on
+		const int blockIndex{ GetDepthIndex(blockX * m_HiZBlockSize, blockY * m_HiZBlockSize) };
+		const int rowStride{ GetDepthRowStride() };
+		for (int y{}; y < m_HiZBlockSize; ++y)
+			std::copy_n(pBlockDepth + y * m_HiZBlockSize, m_HiZBlockSize, m_pDepthBufferPixels + blockIndex + y * rowStride);
+
+		block.isExpanded = true;
+		++statistics.nrDepthBlocksExpanded;
+		statistics.nrDepthBytes += sizeof(DepthBlock) + m_HiZBlockSize * m_HiZBlockSize * sizeof(float);
+	}
+	else
+	{
+		// the plane that is left goes first, the new one second
+		if (oldPlane1Pixels)
+			block.planes[0] = block.planes[1];
+		block.planes[1] = plane;
+		block.planeSelect = writtenPixels;
+		statistics.nrDepthBytes += sizeof(DepthBlock);
+	}
+
+	return *std::max_element(pBlockDepth, pBlockDepth + m_HiZBlockSize * m_HiZBlockSize);
+}
+
+uint32_t RasterizerSoftware::ComputeClipCode(const Vector4& clipPosition) const
+{
+	uint32_t clipCode{};
+	for (int plane{}; plane < NrClipPlanes; ++plane)
+	{
+		if (GetClipDistance(clipPosition, plane) < 0.f)
+			clipCode |= 1u << plane;
+	}
+	return clipCode;
+}
+
+float RasterizerSoftware::GetClipDistance(const Vector4& clipPosition, int plane) const
+{
+	// >= 0 => inside
+	switch (plane)
+	{
+	case ClipNear:		return clipPosition.z;						// z should be >= 0
+	case ClipFar:		return clipPosition.w - clipPosition.z;		// z should be <= 1
+	case ClipLeft:		return clipPosition.w + clipPosition.x;		// x should be >= -1
+	case ClipRight:		return clipPosition.w - clipPosition.x;		// x should be <= 1
+	case ClipBottom:	return clipPosition.w + clipPosition.y;		// y should be >= -1
+	case ClipTop:		return clipPosition.w - clipPosition.y;		// y should be <= 1
+	case GuardBandLeft:		return m_GuardBand * clipPosition.w + clipPosition.x;
+	case GuardBandRight:	return m_GuardBand * clipPosition.w - clipPosition.x;
+	case GuardBandBottom:	return m_GuardBand * clipPosition.w + clipPosition.y;
+	case GuardBandTop:		return m_GuardBand * clipPosition.w - clipPosition.y;
+	default:			return 0.f;
+	}
+}
+
+Vector2 RasterizerSoftware::ToScreenSpace(const Vector4& ndcPosition) const
+{
+	return { (ndcPosition.x + 1) * 0.5f * m_ScreenWidth, (1 - ndcPosition.y) * 0.5f * m_ScreenHeight };
+}
+
+int64_t RasterizerSoftware::ToFixedPoint(float value) const
+{
+	return static_cast<int64_t>(std::floor(value * m_SubPixelScale + 0.5f));
+}
+
+float RasterizerSoftware::Remap(float value, float min, float max) const
+{
+	if (value <= min)
+		return 0;
+	if (value >= max)
+		return 1;
+
+	value = (value - min) / (max - min);
+	return value;
+}
+
+template<typename Config>
+ColorRGB RasterizerSoftware::ShadePixel(const TriangleSetup& setup, int px, int py, float depth, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
+{
+	// Color
+	if constexpr (Config::Output == PixelOutput::Depth)
+	{
+		const float remappedDepth{ Remap(depth, 0.990f, 1.f) };
+		return { remappedDepth, remappedDepth, remappedDepth };
+	}
+	else
+	{
+		// attribute / w at the pixel center
+		// evaluated from the reference pixel instead of stepped => same result whichever tile (or resolve) asks for it
+		const float deltaX{ static_cast<float>(px - setup.minX) };
+		const float deltaY{ static_cast<float>(py - setup.minY) };
+		const auto interpolateAt{ [&](int attribute, float atDeltaX, float atDeltaY)
+			{
+				return setup.atMin[attribute] + setup.stepY[attribute] * atDeltaY + setup.stepX[attribute] * atDeltaX;
+			} };
+		const auto interpolate{ [&](int attribute)
+			{
+				return interpolateAt(attribute, deltaX, deltaY);
+			} };
+
+		const auto normalize{ [](const Vector3& direction)
+			{
+				if constexpr (Config::UsesFastMath)
+					return direction.NormalizedFast();
+				else
+					return direction.Normalized();
+			} };
+
+		// only the attributes this pipeline reads
+		Vertex_Out shadeInfo{};
+		Vector2 uvDx{};
+		Vector2 uvDy{};
+
+		if constexpr (Config::UsesUV)
+		{
+			// perspective correct: divide by the interpolated 1 / w
+			const auto uvAt{ [&](float atDeltaX, float atDeltaY)
+				{
+					float viewSpaceDepth{};
+					if constexpr (Config::UsesFastMath)
+						viewSpaceDepth = FastReciprocal(interpolateAt(TriangleSetup::InverseW, atDeltaX, atDeltaY));
+					else
+						viewSpaceDepth = 1.f / interpolateAt(TriangleSetup::InverseW, atDeltaX, atDeltaY);
+					return Vector2{ interpolateAt(TriangleSetup::U, atDeltaX, atDeltaY), interpolateAt(TriangleSetup::V, atDeltaX, atDeltaY) } * viewSpaceDepth;
+				} };
+			shadeInfo.uv = uvAt(deltaX, deltaY);
+
+			if constexpr (Config::UsesMipMaps)
+			{
+				// coarse derivatives: top left pixel of the 2x2 quad to its right and bottom neighbour
+				// => every pixel of a quad picks the same level, whichever of them are covered (and whichever tile shades them)
+				const float quadDeltaX{ static_cast<float>((px & ~1) - setup.minX) };
+				const float quadDeltaY{ static_cast<float>((py & ~1) - setup.minY) };
+				const Vector2 quadUV{ uvAt(quadDeltaX, quadDeltaY) };
+				uvDx = uvAt(quadDeltaX + 1.f, quadDeltaY) - quadUV;
+				uvDy = uvAt(quadDeltaX, quadDeltaY + 1.f) - quadUV;
+			}
+		}
+
+		// normalizing makes the divide by 1 / w redundant for directions
+		shadeInfo.normal = normalize(Vector3{ interpolate(TriangleSetup::NormalX), interpolate(TriangleSetup::NormalY), interpolate(TriangleSetup::NormalZ) });
+
+		if constexpr (Config::UsesTangent)
+			shadeInfo.tangent = normalize(Vector3{ interpolate(TriangleSetup::TangentX), interpolate(TriangleSetup::TangentY), interpolate(TriangleSetup::TangentZ) });
+
+		if constexpr (Config::UsesViewDirection)
+			shadeInfo.viewDirection = normalize(Vector3{ interpolate(TriangleSetup::ViewDirectionX), interpolate(TriangleSetup::ViewDirectionY), interpolate(TriangleSetup::ViewDirectionZ) });
+
+		// Shade
+		return PixelShadingStage<Config>(shadeInfo, uvDx, uvDy, pDiffuse, pNormal, pSpecular, pGlossiness);
+	}
+}
+
+void RasterizerSoftware::BuildSpecularTable()
+{
+	// same exponent as PixelShadingStage computes from the glossiness map
+	const float divideBy255{ 1.f / 255.f };
+
+	m_SpecularTable.assign(m_SpecularTableRows * m_SpecularTableRowSize, 0);
+	for (int row{}; row < m_SpecularTableRows; ++row)
+	{
+		const float glossiness{ row * divideBy255 * m_SpecularShininess };
+		for (int bin{}; bin <= m_SpecularTableBins; ++bin)
+		{
+			const float cosAngle{ static_cast<float>(bin) / m_SpecularTableBins };
+			const float value{ powf(cosAngle, glossiness) };
+			m_SpecularTable[row * m_SpecularTableRowSize + bin] = static_cast<uint16_t>(value * UINT16_MAX + 0.5f);
+		}
+	}
+}
+
+float RasterizerSoftware::LookupSpecular(float cosAngle, float glossinessSample) const
+{
+	// cosAngle can end up above 1 (normal mapped normals aren't unit length) or nan (degenerate normal)
+	// => outside the table, only a handful of pixels per frame
+	if (!(cosAngle <= 1.f))
+		return powf(cosAngle, glossinessSample * m_SpecularShininess);
+
+	// glossinessSample is the map value in [0, 1] => exactly one row per 8 bit value, clamped like the packet version
+	const int row{ std::clamp(static_cast<int>(glossinessSample * (m_SpecularTableRows - 1) + 0.5f), 0, m_SpecularTableRows - 1) };
+	const float position{ cosAngle * m_SpecularTableBins };
+	const int bin{ std::min(static_cast<int>(position), m_SpecularTableBins - 1) };
+	const float factor{ position - bin };
+
+	const uint16_t* pEntries{ &m_SpecularTable[row * m_SpecularTableRowSize + bin] };
+	return (pEntries[0] + (pEntries[1] - pEntries[0]) * factor) * (1.f / UINT16_MAX);
+}
+
+FloatPacket RasterizerSoftware::LookupSpecular(const FloatPacket& cosAngle, const FloatPacket& glossinessSample) const
+{
+	// same operations as the scalar version, one 32 bit gather loads both end points of a bin
+	const FloatPacket position{ cosAngle * FloatPacket{ static_cast<float>(m_SpecularTableBins) } };
+
+	// lanes that aren't covered can hold anything (nan => INT_MIN) => clamp row and bin to the table
+	__m256i row{ _mm256_cvttps_epi32((glossinessSample * FloatPacket{ m_SpecularTableRows - 1.f } + FloatPacket{ 0.5f }).value) };
+	row = _mm256_max_epi32(_mm256_min_epi32(row, _mm256_set1_epi32(m_SpecularTableRows - 1)), _mm256_setzero_si256());
+	__m256i bin{ _mm256_cvttps_epi32(position.value) };
+	bin = _mm256_max_epi32(_mm256_min_epi32(bin, _mm256_set1_epi32(m_SpecularTableBins - 1)), _mm256_setzero_si256());
+	const FloatPacket factor{ position - FloatPacket{ _mm256_cvtepi32_ps(bin) } };
+
+	const __m256i index{ _mm256_add_epi32(_mm256_mullo_epi32(row, _mm256_set1_epi32(m_SpecularTableRowSize)), bin) };
+	const __m256i entries{ _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_SpecularTable.data()), index, sizeof(uint16_t)) };
+	const FloatPacket start{ _mm256_cvtepi32_ps(_mm256_and_si256(entries, _mm256_set1_epi32(0xFFFF))) };
+	const FloatPacket end{ _mm256_cvtepi32_ps(_mm256_srli_epi32(entries, 16)) };
+
+	const FloatPacket result{ (start + (end - start) * factor) * FloatPacket{ 1.f / UINT16_MAX } };
+
+	// cosAngle above 1 or nan => outside the table, rare enough to only pay for Pow when a lane needs it
+	const FloatPacket isOutside{ _mm256_cmp_ps(cosAngle.value, _mm256_set1_ps(1.f), _CMP_NLE_UQ) };
+	if (_mm256_movemask_ps(isOutside.value) == 0)
+		return result;
+	return Select(isOutside, Pow(cosAngle, glossinessSample * FloatPacket{ m_SpecularShininess }), result);
+}
+
+void RasterizerSoftware::WritePixel(int pixelIndex, ColorRGB color) const
+{
+	// full precision, the resolve clamps and packs
+	if (m_ColorTarget != ColorTarget::Direct)
+	{
+		m_pColorTargetPixels[pixelIndex] = color;
+		return;
+	}
+
+	//Update Color in Buffer
+	color.MaxToOne();
+
+	m_pRenderPixels[pixelIndex] = m_PixelPacking.Pack(
+		static_cast<uint8_t>(color.r * 255),
+		static_cast<uint8_t>(color.g * 255),
+		static_cast<uint8_t>(color.b * 255));
+}
+
+void RasterizerSoftware::WriteBackBufferRow(uint32_t* pPixels, const ColorRGB* pColors, int nrPixels, PackColorsFunction pPackColors) const
+{
+	static_assert(sizeof(ColorRGB) == 3 * sizeof(float), "the packing kernels read ColorRGB as 3 floats");
+	pPackColors(&pColors[0].r, nrPixels, m_PixelPacking, pPixels);
+}
+
+template<typename PixelType>
+void RasterizerSoftware::FillColorRect(PixelType* pPixels, int minX, int minY, int maxX, int maxY, PixelType value) const
+{
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		if (!m_UseTiledLayout)
+		{
+			std::fill(pPixels + minX + py * m_ScreenWidth, pPixels + maxX + py * m_ScreenWidth, value);
+			continue;
+		}
+
+		// tiled => consecutive up to the end of the block
+		for (int px{ minX }; px < maxX;)
+		{
+			const int segmentEnd{ std::min((px / m_HiZBlockSize + 1) * m_HiZBlockSize, maxX) };
+			const int pixelIndex{ GetTiledIndex(px, py) };
+			std::fill(pPixels + pixelIndex, pPixels + pixelIndex + segmentEnd - px, value);
+			px = segmentEnd;
+		}
+	}
+}
+
+void RasterizerSoftware::DetileBackBuffer() const
+{
+	// tiles don't depend on each other => one task per tile, a copy per row of every block
+	m_pThreadPool->ParallelFor(m_NrTilesX * m_NrTilesY, [&](int tileIndex)
+		{
+			// ClearUntouchedTiles already wrote these straight to the back buffer
+			if (m_UseLazyClear && m_TileClearEpochs[tileIndex] != m_FrameEpoch)
+				return;
+
+			const int minX{ (tileIndex % m_NrTilesX) * m_TileSize };
+			const int minY{ (tileIndex / m_NrTilesX) * m_TileSize };
+			const int maxX{ std::min(minX + m_TileSize, m_ScreenWidth) };
+			const int maxY{ std::min(minY + m_TileSize, m_ScreenHeight) };
+
+			for (int py{ minY }; py < maxY; ++py)
+			{
+				for (int px{ minX }; px < maxX; px += m_HiZBlockSize)
+					std::copy_n(m_pTiledBackBufferPixels + GetTiledIndex(px, py), std::min(m_HiZBlockSize, maxX - px), m_pBackBufferPixels + px + py * m_ScreenWidth);
+			}
+		});
+}
+
+int RasterizerSoftware::GetColorIndex(int px, int py) const
+{
+	return m_UseTiledLayout ? GetTiledIndex(px, py) : px + py * m_ScreenWidth;
+}
+
+int RasterizerSoftware::GetDepthIndex(int px, int py) const
+{
+	return m_UseTiledLayout ? GetTiledIndex(px, py) : px + py * m_DepthBufferWidth;
+}
+
+int RasterizerSoftware::GetDepthRowStride() const
+{
+	return m_UseTiledLayout ? m_HiZBlockSize : m_DepthBufferWidth;
+}
+
+int RasterizerSoftware::GetTiledIndex(int px, int py) const
+{
+	// blocks in row major order (same grid as the hierarchical z), pixels row major inside a block
+	const int blockIndex{ px / m_HiZBlockSize + (py / m_HiZBlockSize) * m_HiZWidth };
+	return blockIndex * m_HiZBlockSize * m_HiZBlockSize + (py % m_HiZBlockSize) * m_HiZBlockSize + px % m_HiZBlockSize;
+}
+
+void RasterizerSoftware::TouchTile(int tileIndex, Statistics& statistics)
+{
+	if (m_TileClearEpochs[tileIndex] == m_FrameEpoch)
+		return;
+
+	ClearTile(tileIndex, statistics);
+	m_TileClearEpochs[tileIndex] = m_FrameEpoch;
+	++statistics.nrTilesCleared;
+}
+
+void RasterizerSoftware::ClearTile(int tileIndex, Statistics& statistics)
+{
+	const int tileX{ tileIndex % m_NrTilesX };
+	const int tileY{ tileIndex / m_NrTilesX };
+	const int minX{ tileX * m_TileSize };
+	const int minY{ tileY * m_TileSize };
+
+	// the last column and row of tiles also own the padding of the depth buffer (never written, but read by the span kernels and the block max)
+	const int maxDepthX{ tileX == m_NrTilesX - 1 ? m_DepthBufferWidth : minX + m_TileSize };
+	const int maxDepthY{ tileY == m_NrTilesY - 1 ? m_DepthBufferHeight : minY + m_TileSize };
+	ClearDepth(minX, minY, maxDepthX, maxDepthY, statistics);
+
+	// color, the resolve or RenderFinish reads it next
+	const int maxX{ std::min(minX + m_TileSize, m_ScreenWidth) };
+	const int maxY{ std::min(minY + m_TileSize, m_ScreenHeight) };
+	if (m_ColorTarget != ColorTarget::Direct)
+		FillColorRect(m_pColorTargetPixels, minX, minY, maxX, maxY, m_ClearColor);
+	else
+		FillColorRect(m_pRenderPixels, minX, minY, maxX, maxY, m_PixelPacking.Pack(static_cast<uint8_t>(m_ClearColor.r * 255), static_cast<uint8_t>(m_ClearColor.g * 255), static_cast<uint8_t>(m_ClearColor.b * 255)));
+}
+
+void RasterizerSoftware::ClearUntouchedTiles() const
+{
+	// background only => the clear color, nothing reads these pixels again before the blit
+	// non-temporal stores for the back buffer => the clear doesn't push the rest of the frame out of the cache
+	const uint32_t clearPixel{ m_PixelPacking.Pack(static_cast<uint8_t>(m_ClearColor.r * 255), static_cast<uint8_t>(m_ClearColor.g * 255), static_cast<uint8_t>(m_ClearColor.b * 255)) };
+	const __m128i clearPixels{ _mm_set1_epi32(static_cast<int>(clearPixel)) };
+
+	for (int tileIndex{}; tileIndex < static_cast<int>(m_TileClearEpochs.size()); ++tileIndex)
+	{
+		if (m_TileClearEpochs[tileIndex] == m_FrameEpoch)
+			continue;
+
+		const int minX{ (tileIndex % m_NrTilesX) * m_TileSize };
+		const int minY{ (tileIndex / m_NrTilesX) * m_TileSize };
+		const int maxX{ std::min(minX + m_TileSize, m_ScreenWidth) };
+		const int maxY{ std::min(minY + m_TileSize, m_ScreenHeight) };
+
+		// float target => the resolve reads it right after, normal stores
+		if (m_ColorTarget != ColorTarget::Direct)
+		{
+			FillColorRect(m_pColorTargetPixels, minX, minY, maxX, maxY, m_ClearColor);
+			continue;
+		}
+
+		// always the back buffer itself, DetileBackBuffer skips these tiles
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			uint32_t* pPixel{ m_pBackBufferPixels + minX + py * m_ScreenWidth };
+			uint32_t* const pEnd{ m_pBackBufferPixels + maxX + py * m_ScreenWidth };
+			for (; pPixel < pEnd && reinterpret_cast<uintptr_t>(pPixel) % 16 != 0; ++pPixel)
+				*pPixel = clearPixel;
+			for (; pPixel + 4 <= pEnd; pPixel += 4)
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pPixel), clearPixels);
+			for (; pPixel < pEnd; ++pPixel)
+				*pPixel = clearPixel;
+		}
+	}
+
+	// streaming stores are weakly ordered => done before the blit reads them
+	_mm_sfence();
+}
+
+void RasterizerSoftware::ResolveColorTarget() const
+{
+	// rows don't depend on each other => a few rows per task on the pool, every row in one kernel call
+	const int nrTasks{ (m_ScreenHeight + m_ResolveRowsPerTask - 1) / m_ResolveRowsPerTask };
+	m_pThreadPool->ParallelFor(nrTasks, [&](int taskIndex)
+		{
+			const int minY{ taskIndex * m_ResolveRowsPerTask };
+			const int maxY{ std::min(minY + m_ResolveRowsPerTask, m_ScreenHeight) };
+			for (int py{ minY }; py < maxY; ++py)
+			{
+				uint32_t* pRow{ m_pBackBufferPixels + py * m_ScreenWidth };
+				if (!m_UseTiledLayout)
+				{
+					WriteBackBufferRow(pRow, m_pColorTargetPixels + py * m_ScreenWidth, m_ScreenWidth, m_pResolveColors);
+					continue;
+				}
+
+				// tiled => one call per row of every block
+				for (int px{}; px < m_ScreenWidth; px += m_HiZBlockSize)
+					WriteBackBufferRow(pRow + px, m_pColorTargetPixels + GetTiledIndex(px, py), std::min(m_HiZBlockSize, m_ScreenWidth - px), m_pResolveColors);
+			}
+		});
+}
+
+void RasterizerSoftware::WriteSpan(int pixelIndex, const ColorRGB* pColors, uint32_t mask, PackColorsFunction pPackColors) const
+{
+	// full precision, the resolve clamps and packs
+	if (m_ColorTarget != ColorTarget::Direct)
+	{
+		for (; mask; mask &= mask - 1)
+		{
+			const int lane{ std::countr_zero(mask) };
+			m_pColorTargetPixels[pixelIndex + lane] = pColors[lane];
+		}
+		return;
+	}
+
+	// one run of lanes => packed straight into the back buffer (lanes in the mask always lie inside the row, or the block when tiled)
+	const int firstLane{ std::countr_zero(mask) };
+	const uint32_t lanes{ mask >> firstLane };
+	if ((lanes & (lanes + 1)) == 0)
+	{
+		WriteBackBufferRow(m_pRenderPixels + pixelIndex + firstLane, pColors + firstLane, std::bit_width(lanes), pPackColors);
+		return;
+	}
+
+	// holes => pack the span aside, only copy the lanes in the mask
+	uint32_t pixels[SPAN_WIDTH]{};
+	pPackColors(&pColors[firstLane].r, std::bit_width(lanes), m_PixelPacking, pixels + firstLane);
+
+	for (; mask; mask &= mask - 1)
+	{
+		const int lane{ std::countr_zero(mask) };
+		m_pRenderPixels[pixelIndex + lane] = pixels[lane];
+	}
+}
+
+template<typename Config>
+void RasterizerSoftware::ResolveVisibilityBuffer(int minX, int minY, int maxX, int maxY, Statistics& statistics, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
+{
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		if constexpr (Config::UsesPackets)
+		{
+			// spans of the row, every triangle in a span is shaded as one packet
+			for (int spanX{ minX - minX % SPAN_WIDTH }; spanX < maxX; spanX += SPAN_WIDTH)
+			{
+				int* pTriangleIndices{ m_pVisibilityBuffer + spanX + py * m_ScreenWidth };
+
+				uint32_t remainingMask{};
+				for (int lane{ std::max(minX - spanX, 0) }; lane < std::min(maxX - spanX, SPAN_WIDTH); ++lane)
+				{
+					if (pTriangleIndices[lane] != m_InvalidTriangle)
+						remainingMask |= 1u << lane;
+				}
+
+				while (remainingMask)
+				{
+					const int triangleIndex{ pTriangleIndices[std::countr_zero(remainingMask)] };
+
+					uint32_t mask{};
+					for (uint32_t lanes{ remainingMask }; lanes; lanes &= lanes - 1)
+					{
+						const int lane{ std::countr_zero(lanes) };
+						if (pTriangleIndices[lane] == triangleIndex)
+						{
+							mask |= 1u << lane;
+
+							// consumed => the buffer is clean again for the next mesh
+							pTriangleIndices[lane] = m_InvalidTriangle;
+						}
+					}
+					remainingMask &= ~mask;
+
+					ShadePacket<Config>(m_TriangleSetups[triangleIndex], spanX, py, mask, pDiffuse, pNormal, pSpecular, pGlossiness);
+					statistics.nrPixelsShaded += std::popcount(mask);
+				}
+			}
+			continue;
+		}
+
+		for (int px{ minX }; px < maxX; ++px)
+		{
+			int& triangleIndex{ m_pVisibilityBuffer[px + py * m_ScreenWidth] };
+
+			// not covered by this mesh
+			if (triangleIndex == m_InvalidTriangle)
+				continue;
+
+			const float depth{ ReadDepth(px, py) };
+
+			const ColorRGB finalColor{ ShadePixel<Config>(m_TriangleSetups[triangleIndex], px, py, depth, pDiffuse, pNormal, pSpecular, pGlossiness) };
+			WritePixel(GetColorIndex(px, py), finalColor);
+			++statistics.nrPixelsShaded;
+
+			// consumed => the buffer is clean again for the next mesh
+			triangleIndex = m_InvalidTriangle;
+		}
+	}
+}
+
+template<typename Config>
+ColorRGB RasterizerSoftware::PixelShadingStage(const Vertex_Out& shadeInfo, const Vector2& uvDx, const Vector2& uvDy, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
+{
+	// textures: filtered as the sample state asks, the quad derivatives pick the mip level (level 0 without them), see PixelConfig
+	// material atlas => every map comes out of one fetch, up front
+	MaterialAtlas::MaterialTexels materialTexels{};
+	if constexpr (Config::UsesMaterialAtlas)
+	{
+		if constexpr (Config::UsesMipMaps)
+			materialTexels = m_pMaterialAtlas->Sample(shadeInfo.uv, uvDx, uvDy, m_SampleState);
+		else
+			materialTexels = m_pMaterialAtlas->Sample(shadeInfo.uv, Vector2{}, Vector2{}, m_SampleState);
+	}
+	const auto sample{ [&](Texture* pTexture, MaterialAtlas::Map map)
+		{
+			if constexpr (Config::UsesMaterialAtlas)
+				return materialTexels.maps[map];
+			else if constexpr (Config::UsesMipMaps)
+				return pTexture->Sample(shadeInfo.uv, uvDx, uvDy, m_SampleState);
+			else
+				return pTexture->Sample(shadeInfo.uv, Vector2{}, Vector2{}, m_SampleState);
+		} };
+
+	// normal maps
+	Vector3 sampledNormal{ shadeInfo.normal };
+
+	if constexpr (Config::FlipNormal)
+		sampledNormal = -sampledNormal;
+
+	if constexpr (Config::UseNormalMap)
+	{
+		const Vector3 binormal{ Vector3::Cross(sampledNormal, shadeInfo.tangent) };
+		const Matrix tangentSpace{ Matrix{shadeInfo.tangent, binormal, sampledNormal, Vector3::Zero} };
+
+		const ColorRGB normalSampleColor{ sample(pNormal, MaterialAtlas::Normal) };
+		sampledNormal = Vector3{ normalSampleColor.r, normalSampleColor.g, normalSampleColor.b };
+		sampledNormal = 2.f * sampledNormal - Vector3{ 1, 1, 1 }; // from range [0, 1] to [-1, 1]
+
+		sampledNormal = tangentSpace.TransformVector(sampledNormal);
+	}
+
+	// observed area
+	const float dotProduct{ std::max(Vector3::Dot(sampledNormal, -m_LightDirection), 0.f) };
+	const ColorRGB observedArea = { dotProduct, dotProduct, dotProduct };
+
+	if constexpr (Config::Mode == ShadingMode::ObservedArea)
+	{
+		return observedArea;
+	}
+	else if constexpr (Config::Mode == ShadingMode::Diffuse)
+	{
+		// lambert diffuse
+		const float reflection{ 1.f };
+		ColorRGB lambert{ sample(pDiffuse, MaterialAtlas::Diffuse) * reflection };
+		if constexpr (Config::UsesFastMath)
+			lambert *= 1.f / PI;
+		else
+			lambert /= PI;
+		return lambert * m_LightIntensity * observedArea;
+	}
+	else if constexpr (Config::Mode == ShadingMode::Specular)
+	{
+		// phong
+		const float specularReflection{ 1.f };
+		const float shininess{ 25.f };
+		const ColorRGB specularColor{ sample(pSpecular, MaterialAtlas::Specular) };
+		const float glossinessSample{ sample(pGlossiness, MaterialAtlas::Glossiness).r };	// grayscale map
+		const float glossiness{ glossinessSample * shininess };
+
+		const Vector3 reflect{ Vector3::Reflect(m_LightDirection, sampledNormal) };
+		const float cosAngle{ std::max(Vector3::Dot(reflect, -shadeInfo.viewDirection), 0.f) };
+		float phongValue{};
+		if constexpr (Config::UsesFastMath)
+			phongValue = specularReflection * LookupSpecular(cosAngle, glossinessSample);
+		else
+			phongValue = specularReflection * powf(cosAngle, glossiness);
+		ColorRGB phong{ phongValue, phongValue, phongValue };
+		phong *= specularColor;
+
+		return phong * observedArea;
+	}
+	else
+	{
+		// lambert diffuse
+		const float reflection{ 1.f };
+		ColorRGB lambert{ sample(pDiffuse, MaterialAtlas::Diffuse) * reflection };
+		if constexpr (Config::UsesFastMath)
+			lambert *= 1.f / PI;
+		else
+			lambert /= PI;
+
+		// phong
+		const float specularReflection{ 1.f };
+		const float shininess{ 25.f };
+		const ColorRGB specularColor{ sample(pSpecular, MaterialAtlas::Specular) };
+		const float glossinessSample{ sample(pGlossiness, MaterialAtlas::Glossiness).r };	// grayscale map
+		const float glossiness{ glossinessSample * shininess };
+
+		const Vector3 reflect{ Vector3::Reflect(m_LightDirection, sampledNormal) };
+		const float cosAngle{ std::max(Vector3::Dot(reflect, -shadeInfo.viewDirection), 0.f) };
+		float phongValue{};
+		if constexpr (Config::UsesFastMath)
+			phongValue = specularReflection * LookupSpecular(cosAngle, glossinessSample);
+		else
+			phongValue = specularReflection * powf(cosAngle, glossiness);
+		ColorRGB phong{ phongValue, phongValue, phongValue };
+		phong *= specularColor;
+
+		const ColorRGB ambient{ 0.025f, 0.025f, 0.025f };
+		return observedArea * (lambert * m_LightIntensity + phong + ambient);
+	}
+}
+
+template<typename Config>
+void RasterizerSoftware::ShadePacket(const TriangleSetup& setup, int spanX, int py, uint32_t mask, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const
+{
+	// ShadePixel + PixelShadingStage for the SPAN_WIDTH pixels of a span, in the same order of operations
+	// => same result per lane, except for Pow (see MathSIMD.h)
+	// fast math => same approximations as the scalar version, the specular table gives the exact same result
+	static_assert(PACKET_WIDTH == SPAN_WIDTH, "a packet is one span");
+
+	// attribute / w at the pixel centers
+	const float deltaY{ static_cast<float>(py - setup.minY) };
+	const FloatPacket deltaX{ FloatPacket{ static_cast<float>(spanX - setup.minX) } + FloatPacket::Lanes() };
+	const auto interpolateAt{ [&](int attribute, const FloatPacket& atDeltaX, float atDeltaY)
+		{
+			return FloatPacket{ setup.atMin[attribute] + setup.stepY[attribute] * atDeltaY } + FloatPacket{ setup.stepX[attribute] } * atDeltaX;
+		} };
+	const auto interpolate{ [&](int attribute)
+		{
+			return interpolateAt(attribute, deltaX, deltaY);
+		} };
+	const auto normalize{ [](const Vector3Packet& direction)
+		{
+			if constexpr (Config::UsesFastMath)
+				return direction.NormalizedFast();
+			else
+				return direction.Normalized();
+		} };
+
+	// textures are sampled per lane, only for the covered ones (the others can be far outside the texture)
+	alignas(32) float u[PACKET_WIDTH]{};
+	alignas(32) float v[PACKET_WIDTH]{};
+	alignas(32) float uDx[PACKET_WIDTH]{};
+	alignas(32) float vDx[PACKET_WIDTH]{};
+	alignas(32) float uDy[PACKET_WIDTH]{};
+	alignas(32) float vDy[PACKET_WIDTH]{};
+	if constexpr (Config::UsesUV)
+	{
+		// perspective correct: divide by the interpolated 1 / w
+		const auto uvAt{ [&](const FloatPacket& atDeltaX, float atDeltaY)
+			{
+				FloatPacket viewSpaceDepth{};
+				if constexpr (Config::UsesFastMath)
+					viewSpaceDepth = FastReciprocal(interpolateAt(TriangleSetup::InverseW, atDeltaX, atDeltaY));
+				else
+					viewSpaceDepth = FloatPacket{ 1.f } / interpolateAt(TriangleSetup::InverseW, atDeltaX, atDeltaY);
+				return std::pair{ interpolateAt(TriangleSetup::U, atDeltaX, atDeltaY) * viewSpaceDepth, interpolateAt(TriangleSetup::V, atDeltaX, atDeltaY) * viewSpaceDepth };
+			} };
+		const auto [pixelU, pixelV]{ uvAt(deltaX, deltaY) };
+		pixelU.Store(u);
+		pixelV.Store(v);
+
+		if constexpr (Config::UsesMipMaps)
+		{
+			// coarse derivatives per 2x2 quad, same as ShadePixel (spans start at an even x)
+			const FloatPacket quadDeltaX{ FloatPacket{ static_cast<float>(spanX - setup.minX) } + FloatPacket::QuadLanes() };
+			const float quadDeltaY{ static_cast<float>((py & ~1) - setup.minY) };
+			const auto [quadU, quadV]{ uvAt(quadDeltaX, quadDeltaY) };
+			const auto [rightU, rightV]{ uvAt(quadDeltaX + FloatPacket{ 1.f }, quadDeltaY) };
+			const auto [bottomU, bottomV]{ uvAt(quadDeltaX, quadDeltaY + 1.f) };
+			(rightU - quadU).Store(uDx);
+			(rightV - quadV).Store(vDx);
+			(bottomU - quadU).Store(uDy);
+			(bottomV - quadV).Store(vDy);
+		}
+	}
+
+	// material atlas => one fetch per lane for every map, up front
+	alignas(32) float materialColors[MaterialAtlas::NrMaps][3][PACKET_WIDTH]{};
+	if constexpr (Config::UsesMaterialAtlas)
+	{
+		for (uint32_t lanes{ mask }; lanes; lanes &= lanes - 1)
+		{
+			const int lane{ std::countr_zero(lanes) };
+			MaterialAtlas::MaterialTexels materialTexels{};
+			if constexpr (Config::UsesMipMaps)
+				materialTexels = m_pMaterialAtlas->Sample(Vector2{ u[lane], v[lane] }, Vector2{ uDx[lane], vDx[lane] }, Vector2{ uDy[lane], vDy[lane] }, m_SampleState);
+			else
+				materialTexels = m_pMaterialAtlas->Sample(Vector2{ u[lane], v[lane] }, Vector2{}, Vector2{}, m_SampleState);
+			for (int map{}; map < MaterialAtlas::NrMaps; ++map)
+			{
+				materialColors[map][0][lane] = materialTexels.maps[map].r;
+				materialColors[map][1][lane] = materialTexels.maps[map].g;
+				materialColors[map][2][lane] = materialTexels.maps[map].b;
+			}
+		}
+	}
+
+	const auto sample{ [&](Texture* pTexture, MaterialAtlas::Map map)
+		{
+			if constexpr (Config::UsesMaterialAtlas)
+				return ColorPacket{ FloatPacket::Load(materialColors[map][0]), FloatPacket::Load(materialColors[map][1]), FloatPacket::Load(materialColors[map][2]) };
+
+			alignas(32) float color[3][PACKET_WIDTH]{};
+			for (uint32_t lanes{ mask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane{ std::countr_zero(lanes) };
+				ColorRGB sampledColor{};
+				if constexpr (Config::UsesMipMaps)
+					sampledColor = pTexture->Sample(Vector2{ u[lane], v[lane] }, Vector2{ uDx[lane], vDx[lane] }, Vector2{ uDy[lane], vDy[lane] }, m_SampleState);
+				else
+					sampledColor = pTexture->Sample(Vector2{ u[lane], v[lane] }, Vector2{}, Vector2{}, m_SampleState);
+				color[0][lane] = sampledColor.r;
+				color[1][lane] = sampledColor.g;
+				color[2][lane] = sampledColor.b;
+			}
+			return ColorPacket{ FloatPacket::Load(color[0]), FloatPacket::Load(color[1]), FloatPacket::Load(color[2]) };
+		} };
+
+	// normal maps
+	Vector3Packet sampledNormal{ normalize(Vector3Packet{ interpolate(TriangleSetup::NormalX), interpolate(TriangleSetup::NormalY), interpolate(TriangleSetup::NormalZ) }) };
+
+	if constexpr (Config::FlipNormal)
+		sampledNormal = -sampledNormal;
+
+	if constexpr (Config::UseNormalMap)
+	{
+		const Vector3Packet tangent{ normalize(Vector3Packet{ interpolate(TriangleSetup::TangentX), interpolate(TriangleSetup::TangentY), interpolate(TriangleSetup::TangentZ) }) };
+		const Vector3Packet binormal{ Vector3Packet::Cross(sampledNormal, tangent) };
+
+		// from range [0, 1] to [-1, 1], then tangent space to world
+		const ColorPacket normalSampleColor{ sample(pNormal, MaterialAtlas::Normal) };
+		const FloatPacket two{ 2.f };
+		const FloatPacket one{ 1.f };
+		const FloatPacket x{ two * normalSampleColor.r - one };
+		const FloatPacket y{ two * normalSampleColor.g - one };
+		const FloatPacket z{ two * normalSampleColor.b - one };
+
+		sampledNormal = {	tangent.x * x + binormal.x * y + sampledNormal.x * z,
+							tangent.y * x + binormal.y * y + sampledNormal.y * z,
+							tangent.z * x + binormal.z * y + sampledNormal.z * z };
+	}
+
+	// observed area
+	const Vector3Packet inverseLightDirection{ FloatPacket{ -m_LightDirection.x }, FloatPacket{ -m_LightDirection.y }, FloatPacket{ -m_LightDirection.z } };
+	const FloatPacket dotProduct{ Max(Vector3Packet::Dot(sampledNormal, inverseLightDirection), FloatPacket{ 0.f }) };
+
+	ColorPacket finalColor{ dotProduct, dotProduct, dotProduct };
+
+	if constexpr (Config::UsesDiffuse || Config::UsesSpecular)
+	{
+		ColorPacket shadedColor{};
+
+		if constexpr (Config::UsesDiffuse)
+		{
+			// lambert diffuse
+			const FloatPacket reflection{ 1.f };
+			ColorPacket lambert{ sample(pDiffuse, MaterialAtlas::Diffuse) * reflection };
+			if constexpr (Config::UsesFastMath)
+				lambert = lambert * FloatPacket{ 1.f / PI };
+			else
+				lambert = lambert / FloatPacket{ PI };
+			shadedColor = lambert * FloatPacket{ m_LightIntensity };
+		}
+
+		if constexpr (Config::UsesSpecular)
+		{
+			// phong
+			const FloatPacket specularReflection{ 1.f };
+			const FloatPacket shininess{ 25.f };
+			const ColorPacket specularColor{ sample(pSpecular, MaterialAtlas::Specular) };
+			const FloatPacket glossinessSample{ sample(pGlossiness, MaterialAtlas::Glossiness).r };	// grayscale map
+			const FloatPacket glossiness{ glossinessSample * shininess };
+
+			const Vector3Packet viewDirection{ normalize(Vector3Packet{ interpolate(TriangleSetup::ViewDirectionX), interpolate(TriangleSetup::ViewDirectionY), interpolate(TriangleSetup::ViewDirectionZ) }) };
+			const Vector3Packet lightDirection{ FloatPacket{ m_LightDirection.x }, FloatPacket{ m_LightDirection.y }, FloatPacket{ m_LightDirection.z } };
+			const Vector3Packet reflect{ Vector3Packet::Reflect(lightDirection, sampledNormal) };
+			const FloatPacket cosAngle{ Max(Vector3Packet::Dot(reflect, -viewDirection), FloatPacket{ 0.f }) };
+			FloatPacket phongValue{};
+			if constexpr (Config::UsesFastMath)
+				phongValue = specularReflection * LookupSpecular(cosAngle, glossinessSample);
+			else
+				phongValue = specularReflection * Pow(cosAngle, glossiness);
+			const ColorPacket phong{ ColorPacket{ phongValue, phongValue, phongValue } * specularColor };
+
+			if constexpr (Config::UsesDiffuse)
+			{
+				const FloatPacket ambient{ 0.025f };
+				shadedColor = shadedColor + phong + ColorPacket{ ambient, ambient, ambient };
+			}
+			else
+			{
+				shadedColor = phong;
+			}
+		}
+
+		// combined: observedArea * (...), diffuse: lambert * intensity * observedArea, specular: phong * observedArea
+		if constexpr (Config::Mode == ShadingMode::Combined)
+			finalColor = finalColor * shadedColor;
+		else
+			finalColor = shadedColor * finalColor;
+	}
+
+	// write the covered lanes, packets are only used at the avx2 level => m_pPackColorsSIMD is the avx2 kernel
+	alignas(32) float color[3][PACKET_WIDTH]{};
+	finalColor.r.Store(color[0]);
+	finalColor.g.Store(color[1]);
+	finalColor.b.Store(color[2]);
+
+	ColorRGB spanColors[PACKET_WIDTH]{};
+	for (int lane{}; lane < PACKET_WIDTH; ++lane)
+		spanColors[lane] = ColorRGB{ color[0][lane], color[1][lane], color[2][lane] };
+
+	WriteSpan(GetColorIndex(spanX, py), spanColors, mask, m_pPackColorsSIMD);
+}
+
+RasterizerSoftware::PixelPipeline RasterizerSoftware::SelectPixelPipeline(const DualRasterizerSettings& settings) const
+{
+	if (settings.showBoundingBox)
+		return MakePixelPipeline<PixelConfig<PixelOutput::BoundingBox>>(settings);
+
+	if (settings.showDepthBuffer)
+		return MakePixelPipeline<PixelConfig<PixelOutput::Depth>>(settings);
+
+	// same order as the bool parameters of PixelConfig
+	const bool flipNormal{ settings.cullMode == CullMode::Front };
+	const bool usePackets{ settings.useSimd && settings.useSimdShading && m_SimdLevel == SimdLevel::AVX2 };
+	const bool useMaterialAtlas{ settings.useMaterialAtlas && m_pMaterialAtlas };
+	const bool runtimeFlags[]{ settings.useNormalMap, flipNormal, usePackets, settings.useFastMath, settings.useMipMaps, useMaterialAtlas };
+
+	switch (settings.shadingMode)
+	{
+	case ShadingMode::ObservedArea:
+		return SelectShadedPixelPipeline<ShadingMode::ObservedArea>(settings, runtimeFlags);
+	case ShadingMode::Diffuse:
+		return SelectShadedPixelPipeline<ShadingMode::Diffuse>(settings, runtimeFlags);
+	case ShadingMode::Specular:
+		return SelectShadedPixelPipeline<ShadingMode::Specular>(settings, runtimeFlags);
+	default:
+		return SelectShadedPixelPipeline<ShadingMode::Combined>(settings, runtimeFlags);
+	}
+}
+
+template<ShadingMode shadingMode, bool... flags, size_t nrFlags>
+RasterizerSoftware::PixelPipeline RasterizerSoftware::SelectShadedPixelPipeline(const DualRasterizerSettings& settings, const bool (&runtimeFlags)[nrFlags]) const
+{
+	// one instantiation per combination of the flags: every step turns the next runtime flag into a template argument
+	constexpr size_t flagIndex{ sizeof...(flags) };
+	if constexpr (flagIndex == nrFlags)
+	{
+		return MakePixelPipeline<PixelConfig<PixelOutput::Shaded, shadingMode, flags...>>(settings);
+	}
+	else
+	{
+		if (runtimeFlags[flagIndex])
+			return SelectShadedPixelPipeline<shadingMode, flags..., true>(settings, runtimeFlags);
+		return SelectShadedPixelPipeline<shadingMode, flags..., false>(settings, runtimeFlags);
+	}
+}
+
+template<typename Config>
+RasterizerSoftware::PixelPipeline RasterizerSoftware::MakePixelPipeline(const DualRasterizerSettings& settings) const
+{
+	// deferred => rasterization only writes the visibility buffer, the resolve shades with Config
+	// (the bounding box view has nothing to resolve)
+	if constexpr (Config::Output != PixelOutput::BoundingBox)
+	{
+		if (settings.useVisibilityBuffer)
+			return { &RasterizerSoftware::RasterizeTriangle<PixelConfig<PixelOutput::TriangleIndex>>, &RasterizerSoftware::ResolveVisibilityBuffer<Config> };
+	}
+
+	return { &RasterizerSoftware::RasterizeTriangle<Config>, nullptr };
+}
@@ -2,11 +2,15 @@
 #include "SettingsStruct.h"
 #include "Mesh.h"
 #include "Camera.h"
+#include "RasterizerSIMD.h"
 
 struct SDL_Window;
 
 namespace dae
 {
+	class ThreadPool;
+	struct FloatPacket;
+
 	class RasterizerSoftware final
 	{
 	public:
@@ -18,29 +22,389 @@ namespace dae
 		RasterizerSoftware(RasterizerSoftware&& other) = delete;
 		RasterizerSoftware& operator=(RasterizerSoftware&& other) = delete;
 
-		void RenderStart(const DualRasterizerSettings& settings) const;
-		void RenderMesh(const DualRasterizerSettings& settings, const Camera& camera, Mesh* mesh) const;
+		void RenderStart(const DualRasterizerSettings& settings);
+		void RenderMesh(const DualRasterizerSettings& settings, const Camera& camera, Mesh* mesh);
 		void RenderFinish(SDL_Window* pWindow) const;
+		// RenderFinish without presenting => the frame ends up in the back buffer only, the window isn't touched (benchmarks)
+		void ResolveFrame() const;
+
+		// counters of the last rendered frame
+		struct Statistics
+		{
+			// meshlet culling
+			int nrMeshletsTested{};
+			int nrMeshletsCulled{};
+			int nrTrianglesCulled{};
+
+			// hierarchical z, with tile binning a triangle is counted once per tile it overlaps
+			int nrTrianglesTested{};
+			int nrTrianglesRejected{};
+			int nrBlocksTested{};
+			int nrBlocksRejected{};
+
+			// triangles that crossed the near/far plane or the guard band
+			int nrTrianglesClipped{};
+
+			// pixels that went through PixelShadingStage
+			int nrPixelsShaded{};
+
+			// vertices that went through the projection, each one at most once per mesh
+			int nrVerticesTransformed{};
+
+			// lazy clears: tiles cleared on first touch
+			int nrTilesCleared{};
+
+			// depth buffer memory read + written by the depth test, the hierarchical z updates and the clears
+			int64_t nrDepthBytes{};
+			// plane compressed depth: blocks that needed a third plane and went back to a float per pixel
+			int nrDepthBlocksExpanded{};
+
+			Statistics& operator+=(const Statistics& other)
+			{
+				nrMeshletsTested += other.nrMeshletsTested;
+				nrMeshletsCulled += other.nrMeshletsCulled;
+				nrTrianglesCulled += other.nrTrianglesCulled;
+				nrTrianglesTested += other.nrTrianglesTested;
+				nrTrianglesRejected += other.nrTrianglesRejected;
+				nrBlocksTested += other.nrBlocksTested;
+				nrBlocksRejected += other.nrBlocksRejected;
+				nrTrianglesClipped += other.nrTrianglesClipped;
+				nrPixelsShaded += other.nrPixelsShaded;
+				nrVerticesTransformed += other.nrVerticesTransformed;
+				nrTilesCleared += other.nrTilesCleared;
+				nrDepthBytes += other.nrDepthBytes;
+				nrDepthBlocksExpanded += other.nrDepthBlocksExpanded;
+				return *this;
+			}
+		};
+
+		const Statistics& GetStatistics() const { return m_Statistics; }
+		const SDL_Surface* GetBackBuffer() const { return m_pBackBuffer; }	// the last rendered frame
+		std::vector<uint32_t> CopyBackBuffer() const;	// packed pixels of the last rendered frame, row major without padding
+		SimdLevel GetSimdLevel() const { return m_SimdLevel; }	// widest kernels this cpu runs
 
 	private:
 		// buffers
 		SDL_Surface* m_pFrontBuffer{ nullptr };
 		SDL_Surface* m_pBackBuffer{ nullptr };
 		uint32_t* m_pBackBufferPixels{};
+		PixelPacking m_PixelPacking{};	// format of the back buffer
+
+		// tiled layout (settings.useTiledLayout): color and depth are stored as 8x8 blocks of 64 consecutive pixels
+		// => a block the raster loop works on is 4 cache lines of float depth instead of 8 rows far apart
+		// the raster loop writes packed colors to m_pTiledBackBufferPixels, copied to the back buffer rows in RenderFinish
+		// padded like the depth buffer, see GetColorIndex/GetDepthIndex
+		uint32_t* m_pTiledBackBufferPixels{};
+		uint32_t* m_pRenderPixels{};		// of the current frame: the back buffer or the tiled copy
+		bool m_UseTiledLayout{ false };	// of the current frame
+
+		// optional float color target, resolved to the back buffer in RenderFinish (settings.colorTarget)
+		// => the raster loop only stores the shaded color, clamping/tone mapping and packing happen once per pixel in a parallel pass
+		// same layout as the packed colors, padded like the depth buffer
+		ColorRGB* m_pColorTargetPixels{};
+		ColorTarget m_ColorTarget{ ColorTarget::Direct };	// of the current frame
+		PackColorsFunction m_pResolveColors{ nullptr };		// of the current frame
+		static constexpr int m_ResolveRowsPerTask{ 16 };
 
 		float* m_pDepthBufferPixels{};
+		int m_DepthBufferWidth{};	// padded to a multiple of SPAN_WIDTH
+		int m_DepthBufferHeight{};	// padded to a multiple of m_HiZBlockSize
+
+		// reduced precision depth (settings.depthFormat), same layout as m_pDepthBufferPixels, see EncodeDepthUnorm
+		uint32_t* m_pDepthBufferUnorm24{};
+		uint16_t* m_pDepthBufferUnorm16{};
+		DepthFormat m_DepthFormat{ DepthFormat::Float32 };	// of the current frame
+		SampleState m_SampleState{ SampleState::Point };	// texture filter of the current frame, same as the d3d sampler state
+		const MaterialAtlas* m_pMaterialAtlas{ nullptr };	// of the current mesh, nullptr => the maps are sampled one by one
+
+		// plane compressed depth: the depth plane of the triangle that wrote a pixel, evaluated like the raster loop does => same floats
+		struct DepthPlane
+		{
+			float depthAtMin{ FLT_MAX };	// cleared: FLT_MAX everywhere
+			float depthStepX{};
+			float depthStepY{};
+			int minX{};
+			int minY{};
+
+			float Evaluate(int spanX, int py, int lane) const
+			{
+				const float rowDepth{ depthAtMin + depthStepY * static_cast<float>(py - minY) };
+				const float firstDepth{ rowDepth + depthStepX * static_cast<float>(spanX - minX) };
+				return firstDepth + depthStepX * static_cast<float>(lane);
+			}
+		};
+
+		// one per hierarchical z block: 56 bytes instead of 256
+		// a third triangle in the block => expanded to floats in m_pDepthBufferPixels until the next clear
+		struct DepthBlock
+		{
+			DepthPlane planes[2]{};
+			uint64_t planeSelect{};	// bit (x + y * 8) set => pixel uses planes[1]
+			bool isExpanded{ false };
+		};
+		DepthBlock* m_pDepthBlocks{};
+
+		// hierarchical z: max depth of every 8x8 block of the depth buffer
+		static constexpr int m_HiZBlockSize{ 8 };
+		static constexpr float m_HiZDepthMargin{ 1e-5f };
+		float* m_pHiZ{};
+		int m_HiZWidth{};
+		int m_HiZHeight{};
+
+		// visibility buffer: closest triangle per pixel (index into m_Triangles), shaded in a resolve pass
+		static constexpr int m_InvalidTriangle{ -1 };
+		int* m_pVisibilityBuffer{};
 
 		// directional light
 		const Vector3 m_LightDirection{ .577f, -.577f, .577f };
 		const float m_LightIntensity{ 7.f };
 
+		// fast math: phong pow(cosAngle, glossiness) from a table instead of powf
+		// one row per value of the 8 bit glossiness map => the exponent is exact, cosAngle in [0, 1] is interpolated linearly between bins
+		// unorm16 => 130 KB, fits in L2
+		// max abs error (measured against pow): 1.1e-3 for exponents >= 1, 3.4e-3 for cosAngle >= 1 / 256 => under one step of an 8 bit channel
+		// exponents below 1 are steep near cosAngle 0 => up to 0.41 in the first bin
+		static constexpr int m_SpecularTableRows{ 256 };
+		static constexpr int m_SpecularTableBins{ 256 };
+		static constexpr int m_SpecularTableRowSize{ m_SpecularTableBins + 2 };	// bins + 1 end point + 1 padding => a 32 bit load at the last bin stays in the row
+		static constexpr float m_SpecularShininess{ 25.f };	// same as PixelShadingStage
+		std::vector<uint16_t> m_SpecularTable{};
+
+		// triangle that passed assembly, ready to be rasterized
+		struct Triangle
+		{
+			int index0{};
+			int index1{};
+			int index2{};
+
+			// edge functions in 28.4 fixed point, edge i is opposite of vertex i
+			int64_t edgeOrigin[3]{};	// at the center of pixel (0, 0), fill rule bias included
+			int64_t edgeStepX[3]{};
+			int64_t edgeStepY[3]{};
+
+			// depth plane, relative to (minX, minY)
+			SpanSetup span{};
+			float depthAtMin{};
+			float depthStepY{};
+			float minDepth{};	// slightly below the closest vertex
+
+			// bounding box, max is exclusive
+			int minX{};
+			int minY{};
+			int maxX{};
+			int maxY{};
+		};
+
+		// per triangle setup for shading: plane equations of every attribute / w
+		// value at a pixel = atMin + stepY * (y - minY) + stepX * (x - minX)
+		struct TriangleSetup
+		{
+			enum Attribute
+			{
+				InverseW,
+				ColorR, ColorG, ColorB,
+				U, V,
+				NormalX, NormalY, NormalZ,
+				TangentX, TangentY, TangentZ,
+				ViewDirectionX, ViewDirectionY, ViewDirectionZ,
+				NrAttributes
+			};
+
+			float atMin[NrAttributes]{};
+			float stepX[NrAttributes]{};
+			float stepY[NrAttributes]{};
+
+			// reference pixel
+			int minX{};
+			int minY{};
+		};
+
+		// pixel pipelines: the per pixel settings are template parameters, one instantiation per combination
+		// => the pixel loops have no mode branches and only interpolate and sample what the mode uses
+		enum class PixelOutput
+		{
+			BoundingBox,	// the bounding box in white, no coverage or depth test
+			TriangleIndex,	// deferred: only the visibility buffer is written
+			Depth,			// depth buffer view
+			Shaded
+		};
+
+		template<PixelOutput output, ShadingMode shadingMode = ShadingMode::Combined, bool useNormalMap = false, bool flipNormal = false, bool usePackets = false, bool useFastMath = false, bool useMipMaps = false, bool useMaterialAtlas = false>
+		struct PixelConfig
+		{
+			static constexpr PixelOutput Output{ output };
+			static constexpr ShadingMode Mode{ shadingMode };
+			static constexpr bool UseNormalMap{ useNormalMap };
+			static constexpr bool FlipNormal{ flipNormal };	// front culling => the back side is lit
+			static constexpr bool UsesPackets{ output == PixelOutput::Shaded && usePackets };	// shade a span at a time with MathSIMD (avx2)
+			static constexpr bool UsesFastMath{ output == PixelOutput::Shaded && useFastMath };	// approximate normalize, reciprocal and pow, see MathHelpers.h
+
+			// attributes the shading reads (the vertex color isn't used by any mode)
+			static constexpr bool IsShaded{ output == PixelOutput::Shaded };
+			static constexpr bool UsesDiffuse{ IsShaded && (shadingMode == ShadingMode::Diffuse || shadingMode == ShadingMode::Combined) };
+			static constexpr bool UsesSpecular{ IsShaded && (shadingMode == ShadingMode::Specular || shadingMode == ShadingMode::Combined) };
+			static constexpr bool UsesUV{ IsShaded && (useNormalMap || UsesDiffuse || UsesSpecular) };
+			static constexpr bool UsesTangent{ IsShaded && useNormalMap };
+			static constexpr bool UsesViewDirection{ UsesSpecular };
+			static constexpr bool UsesMipMaps{ UsesUV && useMipMaps };	// uv derivatives per 2x2 quad pick the mip level, else every sample reads level 0
+			static constexpr bool UsesMaterialAtlas{ UsesUV && useMaterialAtlas };	// one fetch of m_pMaterialAtlas for all maps, see MaterialAtlas
+		};
+
+		using RasterizeFunction = void(RasterizerSoftware::*)(const DualRasterizerSettings& settings, int triangleIndex, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY, Statistics& statistics, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+		using ResolveFunction = void(RasterizerSoftware::*)(int minX, int minY, int maxX, int maxY, Statistics& statistics, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+
+		// picked once per mesh
+		struct PixelPipeline
+		{
+			RasterizeFunction pRasterize{ nullptr };
+			ResolveFunction pResolve{ nullptr };	// only deferred
+		};
+
+		// meshlet culling: triangles of the visible meshlets + which vertices they use
+		std::vector<uint32_t> m_VisibleIndices{};
+		std::vector<uint8_t> m_VisibleVertices{};
+
+		// clipping in homogeneous space, bit i of a clip code => outside plane i
+		enum ClipPlane
+		{
+			ClipNear, ClipFar,
+			ClipLeft, ClipRight, ClipBottom, ClipTop,
+			GuardBandLeft, GuardBandRight, GuardBandBottom, GuardBandTop,
+			NrClipPlanes
+		};
+		static constexpr uint32_t m_FrustrumPlanes{ 0b0000111111 };	// all vertices outside one of these => rejected
+		static constexpr uint32_t m_ClipPlanes{ 0b1111000011 };		// only these get clipped, x/y in between is left to the bounding box clamp
+		static constexpr float m_GuardBand{ 16.f };					// in ndc => 16 times the screen size in every direction, easily fits 28.4 fixed point
+		static constexpr int m_MaxClippedVertices{ 3 + 6 };			// every clip plane adds at most one vertex
+
+		std::vector<Vector4> m_ClipPositions{};	// per vertex of pVerticesOut, before the perspective divide
+		std::vector<uint32_t> m_ClipCodes{};	// per vertex of pVerticesOut
+
+		// vertex transform of the current mesh
+		struct VertexTransform
+		{
+			float worldViewProjection[4][4]{};
+			float world[4][4]{};
+			Vector3 cameraOrigin{};
+			const VertexStreams* pVertexStreams{ nullptr };
+			TransformBatchFunction pTransformBatch{ nullptr };
+			bool isDepthOnly{ false };	// only the position is needed => the other streams aren't touched
+		};
+		VertexTransform m_VertexTransform{};
+
+		// lazy transform: a batch of vertices is transformed the first time triangle assembly uses one of them
+		// m_TransformEpochs[batch] == m_TransformEpoch => the batch is transformed for the current mesh
+		std::vector<uint32_t> m_TransformEpochs{};
+		uint32_t m_TransformEpoch{ 0 };
+
+		// large meshes are transformed up front on the thread pool instead, every chunk writes its own range of vertices
+		static constexpr int m_ParallelTransformThreshold{ 4096 };	// in vertices, below this the pool overhead isn't worth it
+		static constexpr int m_TransformChunkSize{ 1024 };			// in vertices
+		static_assert(m_TransformChunkSize % VERTEX_BATCH_SIZE == 0, "chunks can't share a batch");
+
+		// sub pixel precision of the edge functions
+		static constexpr int m_SubPixelBits{ 4 };
+		static constexpr int64_t m_SubPixelScale{ 1 << m_SubPixelBits };
+
+		// tile binning (sort-middle)
+		static constexpr int m_TileSize{ 64 };
+		int m_NrTilesX{};
+		int m_NrTilesY{};
+		std::vector<Triangle> m_Triangles{};
+		std::vector<TriangleSetup> m_TriangleSetups{};	// same order as m_Triangles
+		std::vector<std::vector<int>> m_TileBins{};	// per tile: indices into m_Triangles, in submission order
+
+		// lazy clears: depth, hierarchical z and color of a tile are cleared the first time a triangle touches it in a frame
+		// the tiles nothing touched only get the clear color, once at present
+		// m_TileClearEpochs[tile] == m_FrameEpoch => cleared this frame
+		std::vector<uint32_t> m_TileClearEpochs{};
+		uint32_t m_FrameEpoch{ 0 };
+		bool m_UseLazyClear{ false };	// of the current frame
+		ColorRGB m_ClearColor{};		// of the current frame
+
+		ThreadPool* m_pThreadPool{ nullptr };
+
+		static_assert(m_HiZBlockSize == SPAN_WIDTH, "a block row has to be exactly one span");
+		static_assert(m_TileSize % m_HiZBlockSize == 0, "blocks can't cross tile borders");
+
+		Statistics m_Statistics{};
+		std::vector<Statistics> m_TileStatistics{};
+
+		// coverage/depth, vertex transform and color packing kernels, picked at runtime
+		SimdLevel m_SimdLevel{ SimdLevel::Scalar };
+		CoverageDepthFunction m_pCoverageDepthSIMD{ nullptr };
+		CoverageDepthFunction m_pCoverageDepthScalar{ nullptr };
+		CoverageDepthUnorm24Function m_pCoverageDepthUnorm24SIMD{ nullptr };
+		CoverageDepthUnorm24Function m_pCoverageDepthUnorm24Scalar{ nullptr };
+		CoverageDepthUnorm16Function m_pCoverageDepthUnorm16SIMD{ nullptr };
+		CoverageDepthUnorm16Function m_pCoverageDepthUnorm16Scalar{ nullptr };
+		TransformBatchFunction m_pTransformBatchSIMD{ nullptr };
+		TransformBatchFunction m_pTransformBatchScalar{ nullptr };
+		PackColorsFunction m_pPackColorsSIMD{ nullptr };
+		PackColorsFunction m_pPackColorsScalar{ nullptr };
+		PackColorsFunction m_pToneMapColorsSIMD{ nullptr };
+		PackColorsFunction m_pToneMapColorsScalar{ nullptr };
+
 		// functions
-		void ProjectionStage(const Camera& camera, Matrix* pWorldMatrix, std::vector<Vertex>* pVertices, std::vector<Vertex_Out>* pVerticesOut) const;
-		void RasterizationStage(const DualRasterizerSettings& settings, std::vector<Vertex_Out>* pVerticesOut, std::vector<uint32_t>* pIndices, const PrimitiveTopology& primitiveTopology, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
-		ColorRGB PixelShadingStage(const DualRasterizerSettings& settings, const Vertex_Out shadeInfo, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+		void CullMeshlets(const DualRasterizerSettings& settings, const Camera& camera, const Matrix& worldMatrix, const std::vector<Meshlet>& meshlets, const std::vector<uint32_t>& meshletVertices, const std::vector<uint8_t>& meshletTriangles, int nrVertices);
+		void ProjectionStage(const DualRasterizerSettings& settings, const Camera& camera, Matrix* pWorldMatrix, const VertexStreams* pVertexStreams, const std::vector<uint8_t>* pVertexMask, std::vector<Vertex_Out>* pVerticesOut);
+		int TransformBatch(int batchIndex, std::vector<Vertex_Out>* pVerticesOut);	// returns the number of vertices transformed
+		void FetchVertex(int vertexIndex, std::vector<Vertex_Out>* pVerticesOut);
+		void RasterizationStage(const DualRasterizerSettings& settings, std::vector<Vertex_Out>* pVerticesOut, std::vector<uint32_t>* pIndices, const PrimitiveTopology& primitiveTopology, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness);
+		void SetupTriangle(const DualRasterizerSettings& settings, int index0, int index1, int index2, std::vector<Vertex_Out>* pVerticesOut);
+		int ClipTriangle(int index0, int index1, int index2, uint32_t clipPlanes, std::vector<Vertex_Out>* pVerticesOut, int* pPolygon);
+		int AddClippedVertex(int index0, int index1, float factor, std::vector<Vertex_Out>* pVerticesOut);
+		template<typename Config>
+		void RasterizeTriangle(const DualRasterizerSettings& settings, int triangleIndex, int clipMinX, int clipMinY, int clipMaxX, int clipMaxY, Statistics& statistics, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+		template<typename Config>
+		void ResolveVisibilityBuffer(int minX, int minY, int maxX, int maxY, Statistics& statistics, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+		template<typename Config>
+		ColorRGB ShadePixel(const TriangleSetup& setup, int px, int py, float depth, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+		template<typename Config>
+		ColorRGB PixelShadingStage(const Vertex_Out& shadeInfo, const Vector2& uvDx, const Vector2& uvDy, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+		template<typename Config>
+		void ShadePacket(const TriangleSetup& setup, int spanX, int py, uint32_t mask, Texture* pDiffuse, Texture* pNormal, Texture* pSpecular, Texture* pGlossiness) const;
+
+		// pixel pipeline selection
+		PixelPipeline SelectPixelPipeline(const DualRasterizerSettings& settings) const;
+		template<ShadingMode shadingMode, bool... flags, size_t nrFlags>
+		PixelPipeline SelectShadedPixelPipeline(const DualRasterizerSettings& settings, const bool (&runtimeFlags)[nrFlags]) const;
+		template<typename Config>
+		PixelPipeline MakePixelPipeline(const DualRasterizerSettings& settings) const;
 
 		// helper functions
-		bool IsInsideFrustrum(const Vector4& vertex) const;
+		void BuildSpecularTable();
+		float LookupSpecular(float cosAngle, float glossinessSample) const;
+		FloatPacket LookupSpecular(const FloatPacket& cosAngle, const FloatPacket& glossinessSample) const;
+		// shaded colors go to the back buffer or the color target, depending on m_ColorTarget
+		void WritePixel(int pixelIndex, ColorRGB color) const;
+		void WriteSpan(int pixelIndex, const ColorRGB* pColors, uint32_t mask, PackColorsFunction pPackColors) const;	// only the lanes in mask
+		void WriteBackBufferRow(uint32_t* pPixels, const ColorRGB* pColors, int nrPixels, PackColorsFunction pPackColors) const;
+		template<typename PixelType>
+		void FillColorRect(PixelType* pPixels, int minX, int minY, int maxX, int maxY, PixelType value) const;
+		void DetileBackBuffer() const;
+
+		// tiled or row major, the index of a span start is the start of SPAN_WIDTH consecutive pixels in both
+		int GetColorIndex(int px, int py) const;
+		int GetDepthIndex(int px, int py) const;
+		int GetDepthRowStride() const;	// between py and py + 1 inside a block
+		int GetTiledIndex(int px, int py) const;
+		void ResolveColorTarget() const;
+		void TouchTile(int tileIndex, Statistics& statistics);
+		void ClearTile(int tileIndex, Statistics& statistics);
+		void ClearUntouchedTiles() const;
+
+		// depth formats
+		void ClearDepth(int minX, int minY, int maxX, int maxY, Statistics& statistics);
+		float ReadDepth(int px, int py) const;
+		int GetDepthBytesPerPixel() const;
+		void ExpandDepthBlock(const DepthBlock& block, int blockX, int blockY, float* pBlockDepth) const;
+		float CompressDepthBlock(DepthBlock& block, const DepthPlane& plane, uint64_t writtenPixels, const float* pBlockDepth, int blockX, int blockY, Statistics& statistics) const;
+		float ComputeBlockMaxDepth(int blockX, int blockY) const;
+		uint32_t ComputeClipCode(const Vector4& clipPosition) const;
+		float GetClipDistance(const Vector4& clipPosition, int plane) const;
+		Vector2 ToScreenSpace(const Vector4& ndcPosition) const;
+		int64_t ToFixedPoint(float value) const;
 		float Remap(float value, float min, float max) const;
 
 		// rendering variables
@@ -11,6 +11,8 @@
 #include "RasterizerHardware.h"
 #include "RasterizerSoftware.h"
 
+#include <chrono>
+
 namespace dae {
 
 	Renderer::Renderer(SDL_Window* pWindow) :
@@ -82,16 +84,7 @@ namespace dae {
 
 		// initialize Vehicle
 		EffectShader* shaderEffect = new EffectShader{ pDevice, L"Resources/PosCol3D.fx" };
-		
-		Texture* pTexVehDiffuse = Texture::LoadFromFile(pDevice, "Resources/vehicle_diffuse.png");
-		Texture* pTexVehNormal = Texture::LoadFromFile(pDevice, "Resources/vehicle_normal.png");
-		Texture* pTexVehSpecular = Texture::LoadFromFile(pDevice, "Resources/vehicle_specular.png");
-		Texture* pTexVehGlossiness = Texture::LoadFromFile(pDevice, "Resources/vehicle_gloss.png");
-		
-		shaderEffect->SetDiffuseMap(pTexVehDiffuse);
-		shaderEffect->SetNormalMap(pTexVehNormal);
-		shaderEffect->SetSpecularMap(pTexVehSpecular);
-		shaderEffect->SetGlossinessMap(pTexVehGlossiness);
+		m_pVehicleEffect = shaderEffect;
 
 		shaderEffect->SetSamplerState(newSamplerState);
 		shaderEffect->SetCullMode(newRasterizerState);
@@ -104,17 +97,9 @@ namespace dae {
 		m_pVehicle->SetTranslationMatrix(Matrix::CreateTranslation(0, 0, 50), m_Camera.viewMatrix * m_Camera.projectionMatrix, m_Camera.invViewMatrix);
 		m_pVehicle->SetOnlyHardWare(false);
 		
-		// mesh takes ownership of textures and will delete them
-		m_pVehicle->SetDiffuseMap(pTexVehDiffuse);
-		m_pVehicle->SetNormalMap(pTexVehNormal);
-		m_pVehicle->SetSpecularMap(pTexVehSpecular);
-		m_pVehicle->SetGlossinessMap(pTexVehGlossiness);
-		
 		// initialize Fire
 		EffectTransparency* transparencyEffect = new EffectTransparency{ pDevice, L"Resources/Transparency.fx" };
-		
-		Texture* pFireTexture = Texture::LoadFromFile(pDevice, "Resources/fireFX_diffuse.png");
-		transparencyEffect->SetDiffuseMap(pFireTexture);
+		m_pFireEffect = transparencyEffect;
 
 		transparencyEffect->SetSamplerState(newSamplerState);
 		transparencyEffect->SetCullMode(newRasterizerState);
@@ -124,11 +109,11 @@ namespace dae {
 		Utils::ParseOBJ("Resources/fireFX.obj", vertices, indices);
 		m_pFire = new Mesh{ pDevice, vertices, indices, transparencyEffect };
 		
-		m_pFire->SetDiffuseMap(pFireTexture);
-
 		m_pFire->SetTranslationMatrix(Matrix::CreateTranslation(0, 0, 50), m_Camera.viewMatrix * m_Camera.projectionMatrix, m_Camera.invViewMatrix);
 		m_pFire->SetOnlyHardWare(true);
 
+		LoadTextures();
+
 		newSamplerState->Release();
 		newRasterizerState->Release();
 	}
@@ -203,6 +188,250 @@ namespace dae {
 
 	}
 
+	void Renderer::PrintStatistics() const
+	{
+		// only software
+		if (m_Settings.rasterizerMode != RasterizerMode::SoftWare)
+			return;
+
+		const RasterizerSoftware::Statistics& statistics{ m_pRasterizerSoftware->GetStatistics() };
+
+		std::cout << COUT_COLOR_MAGENTA;
+		std::cout << "   SIMD level: " << SIMD::ToString(m_pRasterizerSoftware->GetSimdLevel()) << "\n";
+		std::cout << "   Meshlets culled: " << statistics.nrMeshletsCulled << "/" << statistics.nrMeshletsTested << " meshlets, "
+			<< statistics.nrTrianglesCulled << " triangles\n";
+		std::cout << "   HiZ rejected: " << statistics.nrTrianglesRejected << "/" << statistics.nrTrianglesTested << " triangles, "
+			<< statistics.nrBlocksRejected << "/" << statistics.nrBlocksTested << " 8x8 blocks, "
+			<< statistics.nrPixelsShaded << " pixels shaded, "
+			<< statistics.nrTrianglesClipped << " triangles clipped\n";
+		std::cout << "   Vertices transformed: " << statistics.nrVerticesTransformed << "\n";
+		std::cout << "   Tiles cleared: " << statistics.nrTilesCleared << "\n";
+		std::cout << "   Depth bytes: " << statistics.nrDepthBytes / 1024 << " KB, "
+			<< statistics.nrDepthBlocksExpanded << " compressed blocks expanded\n";
+		std::cout << COUT_COLOR_RESET;
+	}
+
+	void Renderer::BenchmarkFastMath()
+	{
+		// only software
+		if (m_Settings.rasterizerMode != RasterizerMode::SoftWare)
+			return;
+
+		// the same frame (no update in between) with the exact and the fast math, best time of a few frames each
+		constexpr int nrFrames{ 10 };
+		const bool useFastMath{ m_Settings.useFastMath };
+
+		struct Result
+		{
+			double milliseconds{};
+			int nrPixelsShaded{};
+			std::vector<uint32_t> pixels{};
+		};
+
+		const auto measure{ [&](bool fastMath)
+			{
+				m_Settings.useFastMath = fastMath;
+
+				Result result{};
+				result.milliseconds = DBL_MAX;
+				for (int frame{}; frame < nrFrames; ++frame)
+				{
+					const auto start{ std::chrono::high_resolution_clock::now() };
+					Render();
+					const auto end{ std::chrono::high_resolution_clock::now() };
+					result.milliseconds = std::min(result.milliseconds, std::chrono::duration<double, std::milli>(end - start).count());
+				}
+				result.nrPixelsShaded = m_pRasterizerSoftware->GetStatistics().nrPixelsShaded;
+				result.pixels = m_pRasterizerSoftware->CopyBackBuffer();
+				return result;
+			} };
+
+		const Result exact{ measure(false) };
+		const Result fast{ measure(true) };
+		m_Settings.useFastMath = useFastMath;
+
+		// image error per 8 bit channel
+		const SDL_PixelFormat* pFormat{ m_pRasterizerSoftware->GetBackBuffer()->format };
+		int nrDifferentPixels{};
+		int maxDifference{};
+		double sumDifference{};
+		double sumSquaredDifference{};
+		for (size_t pixel{}; pixel < exact.pixels.size(); ++pixel)
+		{
+			uint8_t exactColor[3]{};
+			uint8_t fastColor[3]{};
+			SDL_GetRGB(exact.pixels[pixel], pFormat, &exactColor[0], &exactColor[1], &exactColor[2]);
+			SDL_GetRGB(fast.pixels[pixel], pFormat, &fastColor[0], &fastColor[1], &fastColor[2]);
+
+			bool isDifferent{ false };
+			for (int channel{}; channel < 3; ++channel)
+			{
+				const int difference{ std::abs(exactColor[channel] - fastColor[channel]) };
+				maxDifference = std::max(maxDifference, difference);
+				sumDifference += difference;
+				sumSquaredDifference += difference * difference;
+				isDifferent |= difference != 0;
+			}
+			nrDifferentPixels += isDifferent;
+		}
+
+		const double nrChannels{ 3.0 * exact.pixels.size() };
+		const double meanSquaredError{ sumSquaredDifference / nrChannels };
+
+		std::cout << COUT_COLOR_MAGENTA;
+		std::cout << "**(SOFTWARE) Fast Math benchmark, best of " << nrFrames << " frames\n";
+		std::cout << "   Exact: " << exact.milliseconds << " ms, " << exact.milliseconds * 1e6 / std::max(exact.nrPixelsShaded, 1) << " ns per shaded pixel\n";
+		std::cout << "   Fast:  " << fast.milliseconds << " ms, " << fast.milliseconds * 1e6 / std::max(fast.nrPixelsShaded, 1) << " ns per shaded pixel\n";
+		std::cout << "   Image: " << nrDifferentPixels << "/" << exact.pixels.size() << " pixels differ, max " << maxDifference
+			<< "/255, mean " << sumDifference / nrChannels << "/255 per channel, PSNR ";
+		if (meanSquaredError > 0.0)
+			std::cout << 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) << " dB\n";
+		else
+			std::cout << "inf (identical)\n";
+		std::cout << COUT_COLOR_RESET;
+	}
+
+	void Renderer::BenchmarkDepthFormats()
+	{
+		// only software
+		if (m_Settings.rasterizerMode != RasterizerMode::SoftWare)
+			return;
+
+		// the current frame (no update in between) in every depth format, on a rasterizer per resolution
+		// the frames stay in the back buffer of that rasterizer, only the window rasterizer presents
+		// full frame with the current settings + depth view (next to no shading => mostly raster and depth test)
+		// the camera keeps the aspect ratio of the window => wider resolutions stretch the image, the work still scales with the pixels
+		constexpr int nrFrames{ 10 };
+		constexpr Int2 resolutions[]{ { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 } };
+		constexpr DepthFormat depthFormats[]{ DepthFormat::Float32, DepthFormat::Unorm24, DepthFormat::Unorm16, DepthFormat::PlaneCompressed };
+		constexpr const char* depthFormatNames[]{ "FLOAT32", "UNORM24", "UNORM16 (reference only)", "PLANE_COMPRESSED" };
+
+		DualRasterizerSettings settings{ m_Settings };
+
+		std::cout << COUT_COLOR_MAGENTA;
+		std::cout << "**(SOFTWARE) Depth Format benchmark, best of " << nrFrames << " frames\n";
+
+		for (const Int2& resolution : resolutions)
+		{
+			RasterizerSoftware rasterizer{ m_pWindow, resolution.x, resolution.y };
+			std::cout << "   " << resolution.x << "x" << resolution.y << "\n";
+
+			const auto measure{ [&](bool showDepthBuffer, int64_t* pNrDepthBytes)
+				{
+					settings.showDepthBuffer = showDepthBuffer;
+
+					double milliseconds{ DBL_MAX };
+					for (int frame{}; frame < nrFrames; ++frame)
+					{
+						const auto start{ std::chrono::high_resolution_clock::now() };
+						rasterizer.RenderStart(settings);
+						rasterizer.RenderMesh(settings, m_Camera, m_pVehicle);
+						rasterizer.ResolveFrame();
+						const auto end{ std::chrono::high_resolution_clock::now() };
+						milliseconds = std::min(milliseconds, std::chrono::duration<double, std::milli>(end - start).count());
+					}
+
+					if (pNrDepthBytes)
+						*pNrDepthBytes = rasterizer.GetStatistics().nrDepthBytes;
+					return milliseconds;
+				} };
+
+			std::vector<uint32_t> referencePixels{};
+			int64_t referenceNrDepthBytes{};
+			double referenceMilliseconds{};
+			for (int formatIndex{}; formatIndex < static_cast<int>(std::size(depthFormats)); ++formatIndex)
+			{
+				settings.depthFormat = depthFormats[formatIndex];
+
+				int64_t nrDepthBytes{};
+				const double depthMilliseconds{ measure(true, nullptr) };
+				const double frameMilliseconds{ measure(false, &nrDepthBytes) };
+				const std::vector<uint32_t> pixels{ rasterizer.CopyBackBuffer() };
+
+				// float is the reference
+				if (formatIndex == 0)
+				{
+					referencePixels = pixels;
+					referenceNrDepthBytes = nrDepthBytes;
+					referenceMilliseconds = depthMilliseconds;
+				}
+
+				int nrDifferentPixels{};
+				for (size_t pixel{}; pixel < pixels.size(); ++pixel)
+					nrDifferentPixels += pixels[pixel] != referencePixels[pixel];
+
+				std::cout << "     " << depthFormatNames[formatIndex] << ": frame " << frameMilliseconds << " ms, depth view " << depthMilliseconds
+					<< " ms (x" << referenceMilliseconds / depthMilliseconds << "), depth bytes " << nrDepthBytes / 1024 << " KB (x"
+					<< static_cast<double>(referenceNrDepthBytes) / std::max<int64_t>(nrDepthBytes, 1) << " less), "
+					<< nrDifferentPixels << " pixels differ\n";
+			}
+		}
+		std::cout << COUT_COLOR_RESET;
+	}
+
+	void Renderer::BenchmarkTiledLayout()
+	{
+		// only software
+		if (m_Settings.rasterizerMode != RasterizerMode::SoftWare)
+			return;
+
+		// the current frame (no update in between) in both layouts, on a rasterizer per resolution, same setup as BenchmarkDepthFormats
+		// with and without tile binning: without it a triangle can touch the whole screen between two blocks
+		constexpr int nrFrames{ 10 };
+		constexpr Int2 resolutions[]{ { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 } };
+
+		DualRasterizerSettings settings{ m_Settings };
+
+		std::cout << COUT_COLOR_MAGENTA;
+		std::cout << "**(SOFTWARE) Tiled Layout benchmark, best of " << nrFrames << " frames, row major / tiled\n";
+
+		for (const Int2& resolution : resolutions)
+		{
+			RasterizerSoftware rasterizer{ m_pWindow, resolution.x, resolution.y };
+			std::cout << "   " << resolution.x << "x" << resolution.y << "\n";
+
+			const auto measure{ [&](bool useTiledLayout, int* pNrPixelsShaded)
+				{
+					settings.useTiledLayout = useTiledLayout;
+
+					double milliseconds{ DBL_MAX };
+					for (int frame{}; frame < nrFrames; ++frame)
+					{
+						const auto start{ std::chrono::high_resolution_clock::now() };
+						rasterizer.RenderStart(settings);
+						rasterizer.RenderMesh(settings, m_Camera, m_pVehicle);
+						rasterizer.ResolveFrame();
+						const auto end{ std::chrono::high_resolution_clock::now() };
+						milliseconds = std::min(milliseconds, std::chrono::duration<double, std::milli>(end - start).count());
+					}
+
+					*pNrPixelsShaded = rasterizer.GetStatistics().nrPixelsShaded;
+					return milliseconds;
+				} };
+
+			for (const bool useTileBinning : { true, false })
+			{
+				for (const bool showDepthBuffer : { false, true })
+				{
+					settings.useTileBinning = useTileBinning;
+					settings.showDepthBuffer = showDepthBuffer;
+
+					int nrPixelsShaded{};
+					const double rowMajorMilliseconds{ measure(false, &nrPixelsShaded) };
+					const std::vector<uint32_t> rowMajorPixels{ rasterizer.CopyBackBuffer() };
+					const double tiledMilliseconds{ measure(true, &nrPixelsShaded) };
+					const bool isSameImage{ rasterizer.CopyBackBuffer() == rowMajorPixels };
+
+					std::cout << "     " << (useTileBinning ? "binned, " : "not binned, ") << (showDepthBuffer ? "depth view: " : "frame: ")
+						<< rowMajorMilliseconds << " / " << tiledMilliseconds << " ms (x" << rowMajorMilliseconds / tiledMilliseconds << "), "
+						<< rowMajorMilliseconds * 1e6 / std::max(nrPixelsShaded, 1) << " / " << tiledMilliseconds * 1e6 / std::max(nrPixelsShaded, 1) << " ns per shaded pixel"
+						<< (isSameImage ? "" : ", IMAGES DIFFER") << "\n";
+				}
+			}
+		}
+		std::cout << COUT_COLOR_RESET;
+	}
+
 	void Renderer::ToggleSoftwareOrHardware()
 	{
 		std::cout << COUT_COLOR_YELLOW;
@@ -322,55 +551,53 @@ namespace dae {
 
 	void Renderer::CycleSampleStates()
 	{
-		// only hardware
-		if (m_Settings.rasterizerMode == RasterizerMode::Hardware)
-		{
-			std::cout << COUT_COLOR_GREEN;
-			std::cout << "**(HARDWARE) Show FireFX = ";
+		// shared: the software rasterizer filters its textures the same way
+		std::cout << COUT_COLOR_YELLOW;
+		std::cout << "**(SHARED) Sampler State = ";
 
-			D3D11_SAMPLER_DESC samplerDesc{};
-			samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.MinLOD = -FLT_MAX;
-			samplerDesc.MaxLOD = FLT_MAX;
-			samplerDesc.MipLODBias = 0.f;
-			samplerDesc.MaxAnisotropy = 1;
-			samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-
-			switch (m_Settings.sampleState)
-			{
-			case dae::SampleState::Point:
-				m_Settings.sampleState = SampleState::Linear;
-				samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-				std::cout << "LINEAR\n";
-				break;
-			case dae::SampleState::Linear:
-				m_Settings.sampleState = SampleState::Anisotropic;
-				samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-				std::cout << "ANISOTROPIC\n";
-				break;
-			case dae::SampleState::Anisotropic:
-				m_Settings.sampleState = SampleState::Point;
-				samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
-				std::cout << "POINT\n";
-				break;
-			}
+		D3D11_SAMPLER_DESC samplerDesc{};
+		samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+		samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+		samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+		samplerDesc.MinLOD = -FLT_MAX;
+		samplerDesc.MaxLOD = FLT_MAX;
+		samplerDesc.MipLODBias = 0.f;
+		samplerDesc.MaxAnisotropy = 1;
+		samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
 
-			ID3D11Device* pDevice = m_pRasterizerHardware->GetDevice();
-			ID3D11SamplerState* newSamplerState{};
+		switch (m_Settings.sampleState)
+		{
+		case dae::SampleState::Point:
+			m_Settings.sampleState = SampleState::Linear;
+			samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+			std::cout << "LINEAR\n";
+			break;
+		case dae::SampleState::Linear:
+			m_Settings.sampleState = SampleState::Anisotropic;
+			samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+			samplerDesc.MaxAnisotropy = MAX_ANISOTROPY;
+			std::cout << "ANISOTROPIC\n";
+			break;
+		case dae::SampleState::Anisotropic:
+			m_Settings.sampleState = SampleState::Point;
+			samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
+			std::cout << "POINT\n";
+			break;
+		}
 
-			HRESULT result = pDevice->CreateSamplerState(&samplerDesc, &newSamplerState);
-			if (FAILED(result))
-				std::wcout << L"new samplerState failed\n";
+		ID3D11Device* pDevice = m_pRasterizerHardware->GetDevice();
+		ID3D11SamplerState* newSamplerState{};
+
+		HRESULT result = pDevice->CreateSamplerState(&samplerDesc, &newSamplerState);
+		if (FAILED(result))
+			std::wcout << L"new samplerState failed\n";
 
-			m_pVehicle->SetSamplerState(newSamplerState);
-			m_pFire->SetSamplerState(newSamplerState);
+		m_pVehicle->SetSamplerState(newSamplerState);
+		m_pFire->SetSamplerState(newSamplerState);
 
-			newSamplerState->Release();
+		newSamplerState->Release();
 
-			std::cout << COUT_COLOR_RESET;
-		}
+		std::cout << COUT_COLOR_RESET;
 	}
 
 	void Renderer::CycleShadingMode()
@@ -465,6 +692,338 @@ namespace dae {
 		}
 	}
 
+	void Renderer::ToggleTileBinning()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Tile Binning (multithreaded) = ";
+
+			m_Settings.useTileBinning = !m_Settings.useTileBinning;
+
+			if (m_Settings.useTileBinning)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleSimd()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) SIMD coverage/depth (" << SIMD::ToString(m_pRasterizerSoftware->GetSimdLevel()) << ") = ";
+
+			m_Settings.useSimd = !m_Settings.useSimd;
+
+			if (m_Settings.useSimd)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleHiZ()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Hierarchical Z = ";
+
+			m_Settings.useHiZ = !m_Settings.useHiZ;
+
+			if (m_Settings.useHiZ)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleVisibilityBuffer()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Visibility Buffer (deferred shading) = ";
+
+			m_Settings.useVisibilityBuffer = !m_Settings.useVisibilityBuffer;
+
+			if (m_Settings.useVisibilityBuffer)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleMeshletCulling()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Meshlet Culling = ";
+
+			m_Settings.useMeshletCulling = !m_Settings.useMeshletCulling;
+
+			if (m_Settings.useMeshletCulling)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleLazyTransform()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Lazy Vertex Transform = ";
+
+			m_Settings.useLazyTransform = !m_Settings.useLazyTransform;
+
+			if (m_Settings.useLazyTransform)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleSimdShading()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) SIMD Shading = ";
+
+			m_Settings.useSimdShading = !m_Settings.useSimdShading;
+
+			if (m_Settings.useSimdShading)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleFastMath()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Fast Math = ";
+
+			m_Settings.useFastMath = !m_Settings.useFastMath;
+
+			if (m_Settings.useFastMath)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::CycleColorTarget()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Color Target = ";
+
+			switch (m_Settings.colorTarget)
+			{
+			case dae::ColorTarget::Direct:
+				m_Settings.colorTarget = ColorTarget::HDR;
+				std::cout << "HDR\n";
+				break;
+			case dae::ColorTarget::HDR:
+				m_Settings.colorTarget = ColorTarget::HDRToneMapped;
+				std::cout << "HDR_TONEMAPPED\n";
+				break;
+			case dae::ColorTarget::HDRToneMapped:
+				m_Settings.colorTarget = ColorTarget::Direct;
+				std::cout << "DIRECT\n";
+				break;
+			}
+
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::CycleDepthFormat()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Depth Format = ";
+
+			switch (m_Settings.depthFormat)
+			{
+			case dae::DepthFormat::Float32:
+				m_Settings.depthFormat = DepthFormat::Unorm24;
+				std::cout << "UNORM24\n";
+				break;
+			case dae::DepthFormat::Unorm24:
+			case dae::DepthFormat::Unorm16:
+				m_Settings.depthFormat = DepthFormat::PlaneCompressed;
+				std::cout << "PLANE_COMPRESSED\n";
+				break;
+			case dae::DepthFormat::PlaneCompressed:
+				m_Settings.depthFormat = DepthFormat::Float32;
+				std::cout << "FLOAT32\n";
+				break;
+			}
+
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleLazyClear()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Lazy Clear = ";
+
+			m_Settings.useLazyClear = !m_Settings.useLazyClear;
+
+			if (m_Settings.useLazyClear)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleTiledLayout()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Tiled Layout = ";
+
+			m_Settings.useTiledLayout = !m_Settings.useTiledLayout;
+
+			if (m_Settings.useTiledLayout)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleMipMaps()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Mip Maps = ";
+
+			m_Settings.useMipMaps = !m_Settings.useMipMaps;
+
+			if (m_Settings.useMipMaps)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleMaterialAtlas()
+	{
+		// only software
+		if (m_Settings.rasterizerMode == RasterizerMode::SoftWare)
+		{
+			std::cout << COUT_COLOR_MAGENTA;
+			std::cout << "**(SOFTWARE) Material Atlas = ";
+
+			m_Settings.useMaterialAtlas = !m_Settings.useMaterialAtlas;
+			UpdateMaterialAtlas();
+
+			if (m_Settings.useMaterialAtlas && m_Settings.useTextureCompression)
+				std::cout << "ON (unused while textures are compressed)\n";
+			else if (m_Settings.useMaterialAtlas)
+				std::cout << "ON\n";
+			else
+				std::cout << "OFF\n";
+			std::cout << COUT_COLOR_RESET;
+		}
+	}
+
+	void Renderer::ToggleTextureCompression()
+	{
+		std::cout << COUT_COLOR_YELLOW;
+		std::cout << "**(SHARED) Texture Compression = ";
+
+		m_Settings.useTextureCompression = !m_Settings.useTextureCompression;
+		LoadTextures();
+
+		if (m_Settings.useTextureCompression)
+			std::cout << "ON\n";
+		else
+			std::cout << "OFF\n";
+		std::cout << COUT_COLOR_RESET;
+	}
+
+	void Renderer::LoadTextures()
+	{
+		// borrow device, DO NOT DESTROY
+		ID3D11Device* pDevice{ m_pRasterizerHardware->GetDevice() };
+
+		// compressed: colors BC1, alpha BC3, normals BC5 (x and y), grayscale BC4
+		const bool compress{ m_Settings.useTextureCompression };
+		const auto format{ [compress](BlockFormat blockFormat) { return compress ? blockFormat : BlockFormat::None; } };
+
+		Texture* pTexVehDiffuse = Texture::LoadFromFile(pDevice, "Resources/vehicle_diffuse.png", format(BlockFormat::BC1));
+		Texture* pTexVehNormal = Texture::LoadFromFile(pDevice, "Resources/vehicle_normal.png", format(BlockFormat::BC5));
+		Texture* pTexVehSpecular = Texture::LoadFromFile(pDevice, "Resources/vehicle_specular.png", format(BlockFormat::BC1));
+		Texture* pTexVehGlossiness = Texture::LoadFromFile(pDevice, "Resources/vehicle_gloss.png", format(BlockFormat::BC4));
+
+		m_pVehicleEffect->SetDiffuseMap(pTexVehDiffuse);
+		m_pVehicleEffect->SetNormalMap(pTexVehNormal);
+		m_pVehicleEffect->SetSpecularMap(pTexVehSpecular);
+		m_pVehicleEffect->SetGlossinessMap(pTexVehGlossiness);
+
+		// mesh takes ownership of textures and will delete them (the previous ones as well)
+		m_pVehicle->SetDiffuseMap(pTexVehDiffuse);
+		m_pVehicle->SetNormalMap(pTexVehNormal);
+		m_pVehicle->SetSpecularMap(pTexVehSpecular);
+		m_pVehicle->SetGlossinessMap(pTexVehGlossiness);
+		UpdateMaterialAtlas();
+
+		Texture* pFireTexture = Texture::LoadFromFile(pDevice, "Resources/fireFX_diffuse.png", format(BlockFormat::BC3));
+		m_pFireEffect->SetDiffuseMap(pFireTexture);
+		m_pFire->SetDiffuseMap(pFireTexture);
+	}
+
+	void Renderer::UpdateMaterialAtlas()
+	{
+		// off by default => no second copy of the maps unless it is sampled
+		// compressed maps => not built, 8 bytes per texel would undo the compression (the separate maps are sampled instead)
+		if (m_Settings.useMaterialAtlas && !m_Settings.useTextureCompression)
+			m_pVehicle->BuildMaterialAtlas();
+		else
+			m_pVehicle->ReleaseMaterialAtlas();
+	}
+
 	void Renderer::PrintKeyBindings()
 	{
 		std::cout << COUT_COLOR_YELLOW;
@@ -473,19 +1032,37 @@ namespace dae {
 			<< "   [F2]  Toggle Vehicle Rotation (ON/OFF)\n"
 			<< "   [F9]  Cycle CullMode (BACK/FRONT/NONE)\n"
 			<< "   [F10] Toggle Uniform ClearColor (ON/OFF)\n"
+			<< "   [F4]  Cycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n"
+			<< "   [B]   Toggle Texture Compression, BC1/BC3/BC4/BC5 blocks (ON/OFF)\n"
 			<< "   [F11] Toggle Print FPS (ON/OFF)\n";
 
 		std::cout << COUT_COLOR_GREEN;
 		std::cout << "[Key Bindings - HARDWARE]\n"
-			<< "   [F3]  Toggle FireFX (ON/OFF)\n"
-			<< "   [F4]  Cycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n";
+			<< "   [F3]  Toggle FireFX (ON/OFF)\n";
 
 		std::cout << COUT_COLOR_MAGENTA;
 		std::cout << "[Key Bindings - SOFTWARE]\n"
 			<< "   [F5]  Cycle Shading Mode (COMBINED/OBSERVED_AREA/DIFFUSE/SPECULAR)\n"
 			<< "   [F6]  Toggle NormalMap (ON/OFF)\n"
 			<< "   [F7]  Toggle DepthBuffer Visualization (ON/OFF)\n"
-			<< "   [F8]  Toggle BoundingBox Visualization (ON/OFF)\n";
+			<< "   [F8]  Toggle BoundingBox Visualization (ON/OFF)\n"
+			<< "   [1]   Toggle Tile Binning, multithreaded (ON/OFF)\n"
+			<< "   [2]   Toggle SIMD coverage/depth tests (ON/OFF)\n"
+			<< "   [3]   Toggle Hierarchical Z rejection (ON/OFF)\n"
+			<< "   [4]   Toggle Visibility Buffer, deferred shading (ON/OFF)\n"
+			<< "   [5]   Toggle Meshlet Culling, frustrum + normal cone (ON/OFF)\n"
+			<< "   [6]   Toggle Lazy Vertex Transform (ON/OFF)\n"
+			<< "   [7]   Toggle SIMD Shading, 8 pixels at a time (ON/OFF)\n"
+			<< "   [8]   Toggle Fast Math, approximate normalize and specular (ON/OFF)\n"
+			<< "   [9]   Benchmark Fast Math against the exact math (time + image error)\n"
+			<< "   [0]   Cycle Color Target, float + parallel resolve (DIRECT/HDR/HDR_TONEMAPPED)\n"
+			<< "   [C]   Toggle Lazy Clear, per tile on first touch (ON/OFF)\n"
+			<< "   [Z]   Cycle Depth Format (FLOAT32/UNORM24/PLANE_COMPRESSED)\n"
+			<< "   [X]   Benchmark Depth Formats at several resolutions (time + depth bytes + image)\n"
+			<< "   [T]   Toggle Tiled Layout, 8x8 blocks for color + depth (ON/OFF)\n"
+			<< "   [Y]   Benchmark Tiled Layout against row major at several resolutions (time + image)\n"
+			<< "   [M]   Toggle Mip Maps, level picked from per quad uv derivatives (ON/OFF)\n"
+			<< "   [I]   Toggle Material Atlas, all maps in one fetch with gray specular (ON/OFF)\n";
 
 		std::cout << COUT_COLOR_RESET;
 	}
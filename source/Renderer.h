@@ -8,6 +8,8 @@ struct SDL_Surface;
 namespace dae
 {
 	class Mesh;
+	class EffectShader;
+	class EffectTransparency;
 	class RasterizerHardware;
 	class RasterizerSoftware;
 
@@ -24,6 +26,10 @@ namespace dae
 
 		void Update(const Timer* pTimer);
 		void Render() const;
+		void PrintStatistics() const;
+		void BenchmarkFastMath();
+		void BenchmarkDepthFormats();
+		void BenchmarkTiledLayout();
 
 		// toggle settings
 		void ToggleSoftwareOrHardware();
@@ -36,6 +42,21 @@ namespace dae
 		void ToggleNormalMap();
 		void ToggleDepthBuffer();
 		void ToggleBoundingBox();
+		void ToggleTileBinning();
+		void ToggleSimd();
+		void ToggleHiZ();
+		void ToggleVisibilityBuffer();
+		void ToggleMeshletCulling();
+		void ToggleLazyTransform();
+		void ToggleSimdShading();
+		void ToggleFastMath();
+		void CycleColorTarget();
+		void ToggleLazyClear();
+		void CycleDepthFormat();
+		void ToggleTiledLayout();
+		void ToggleMipMaps();
+		void ToggleMaterialAtlas();
+		void ToggleTextureCompression();
 
 	private:
 		SDL_Window* m_pWindow{};
@@ -49,11 +70,18 @@ namespace dae
 		// helper functions
 		// =======================
 		void PrintKeyBindings();
+		// (re)loads the maps of both meshes, compressed or not
+		void LoadTextures();
+		// builds the material atlas of the vehicle while settings.useMaterialAtlas is on, frees it otherwise
+		void UpdateMaterialAtlas();
 
 		// meshes
 		// =======================
 		Mesh* m_pVehicle;
 		Mesh* m_pFire;
+		// owned by the meshes
+		EffectShader* m_pVehicleEffect{};
+		EffectTransparency* m_pFireEffect{};
 
 		// rasterizers
 		// =======================
@@ -8,6 +8,7 @@ Texture2D gDiffuseMap : DiffuseMap;
 Texture2D gNormalMap : NormalMap;
 Texture2D gSpecularMap : SpecularMap;
 Texture2D gGlossinessMap : GlossinessMap;
+bool gIsNormalMapXY = false;	// BC5: only x and y are stored, z is rebuilt
 
 float3 gLightDirection = float3(0.577f, -0.577f, 0.577f);
 float gLightIntensity = 7.0f;
@@ -107,6 +108,8 @@ float4 PS(VS_OUTPUT input) : SV_TARGET
 	
 	sampledNormal = gNormalMap.Sample(gSamplerState, input.UV).rgb;
 	sampledNormal = 2.0f * sampledNormal - float3(1.0f, 1.0f, 1.0f);
+	if (gIsNormalMapXY)
+		sampledNormal.z = sqrt(saturate(1.0f - dot(sampledNormal.xy, sampledNormal.xy)));
 	sampledNormal = normalize(mul(float4(sampledNormal, 0.0f), tangentSpace)).rgb;
 
 	// observedArea
@@ -27,6 +27,19 @@ namespace dae
 		Diffuse,
 		Specular
 	};
+	enum class ColorTarget
+	{
+		Direct,			// 8 bit back buffer, written in the raster loop
+		HDR,			// float target, resolved with MaxToOne => same image as direct
+		HDRToneMapped	// float target, resolved with a filmic tone map + srgb gamma
+	};
+	enum class DepthFormat
+	{
+		Float32,			// float per pixel
+		Unorm24,			// 24 bits in a 32 bit pixel, stored inverted (see EncodeDepthUnorm)
+		Unorm16,			// half the bytes of float, too coarse for the scene => benchmark reference only, not in CycleDepthFormat
+		PlaneCompressed		// 8x8 blocks covered by at most 2 triangles are stored as their depth planes, float per pixel otherwise
+	};
 
 	// SETTINGS
 	struct DualRasterizerSettings
@@ -36,6 +49,7 @@ namespace dae
 		bool rotating{ true };
 		CullMode cullMode{ CullMode::None };
 		bool uniformBackGround{ false };
+		bool useTextureCompression{ false };	// picked at load => toggling reloads the textures
 
 		// only hardware
 		bool showFireMesh{ true };
@@ -46,6 +60,20 @@ namespace dae
 		bool useNormalMap{ true };
 		bool showDepthBuffer{ false };
 		bool showBoundingBox{ false };
+		bool useTileBinning{ true };
+		bool useSimd{ true };
+		bool useHiZ{ true };
+		bool useVisibilityBuffer{ false };
+		bool useMeshletCulling{ true };
+		bool useLazyTransform{ true };
+		bool useSimdShading{ true };
+		bool useFastMath{ false };
+		ColorTarget colorTarget{ ColorTarget::Direct };
+		bool useLazyClear{ true };
+		DepthFormat depthFormat{ DepthFormat::Float32 };
+		bool useTiledLayout{ false };
+		bool useMipMaps{ false };	// off: the derivatives and level of detail per sample cost more than the smaller levels save on the default view (up to 2x the frame)
+		bool useMaterialAtlas{ false };	// specular is stored gray in the atlas => not quite the same image
 	};
 
 }
\ No newline at end of file
@@ -1,20 +1,49 @@
-
 #include "pch.h"
 #include "Texture.h"
-#include "Vector2.h"
 #include <SDL_image.h>
 
 namespace dae
 {
-	Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface) : 
-		m_pSurface{pSurface},
-		m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+	Texture::Texture(ID3D11Device* pDevice, SDL_Surface* pSurface, BlockFormat blockFormat)
 	{
-		DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		// one known layout whatever the file was (24 bit, palette, ...), also the layout of the d3d texture
+		// the mip chain (and the d3d texture) is all that is sampled => the surfaces aren't kept
+		const int width{ pSurface->w };
+		const int height{ pSurface->h };
+		SDL_Surface* pTexels{ SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+		SDL_FreeSurface(pSurface);
+		const std::vector<std::vector<uint32_t>> mipChain{ BuildMipChain(pTexels) };
+		SDL_FreeSurface(pTexels);
+
+		// d3d only takes block compressed textures made of whole blocks => the others stay R8G8B8A8
+		if (width % BlockCompression::BLOCK_SIZE != 0 || height % BlockCompression::BLOCK_SIZE != 0)
+			blockFormat = BlockFormat::None;
+		m_BlockFormat = blockFormat;
+
+		// compressed: every level is encoded once, the d3d texture and the software copy share the blocks
+		std::vector<std::vector<uint8_t>> compressedMipChain{};
+		if (blockFormat == BlockFormat::None)
+		{
+			m_MipChain.Build(mipChain, width, height);
+		}
+		else
+		{
+			int levelWidth{ width };
+			int levelHeight{ height };
+			for (const std::vector<uint32_t>& level : mipChain)
+			{
+				compressedMipChain.push_back(BlockCompression::EncodeLevel(level, levelWidth, levelHeight, blockFormat));
+				levelWidth = std::max(levelWidth / 2, 1);
+				levelHeight = std::max(levelHeight / 2, 1);
+			}
+			m_MipChain.BuildCompressed(compressedMipChain, width, height, blockFormat);
+		}
+
+		DXGI_FORMAT format{ GetFormat(blockFormat) };
 		D3D11_TEXTURE2D_DESC desc{};
-		desc.Width = m_pSurface->w;
-		desc.Height = m_pSurface->h;
-		desc.MipLevels = 1;
+		desc.Width = width;
+		desc.Height = height;
+		desc.MipLevels = static_cast<UINT>(mipChain.size());
 		desc.ArraySize = 1;
 		desc.Format = format;
 		desc.SampleDesc.Count = 1;
@@ -24,12 +53,31 @@ namespace dae
 		desc.CPUAccessFlags = 0;
 		desc.MiscFlags = 0;
 
-		D3D11_SUBRESOURCE_DATA initData;
-		initData.pSysMem = m_pSurface->pixels;
-		initData.SysMemPitch = static_cast<UINT>(m_pSurface->pitch);
-		initData.SysMemSlicePitch = static_cast<UINT>(m_pSurface->h * m_pSurface->pitch);
+		// one subresource per mip level, same texels as the software copy
+		// compressed: a row is a row of blocks, levels smaller than a block are one (partly used) block
+		std::vector<D3D11_SUBRESOURCE_DATA> initData(mipChain.size());
+		for (size_t level{}; level < mipChain.size(); ++level)
+		{
+			const UINT levelWidth{ static_cast<UINT>(m_MipChain.GetWidth(static_cast<int>(level))) };
+			const UINT levelHeight{ static_cast<UINT>(m_MipChain.GetHeight(static_cast<int>(level))) };
+			if (blockFormat == BlockFormat::None)
+			{
+				const UINT pitch{ static_cast<UINT>(levelWidth * sizeof(uint32_t)) };
+				initData[level].pSysMem = mipChain[level].data();
+				initData[level].SysMemPitch = pitch;
+				initData[level].SysMemSlicePitch = pitch * levelHeight;
+			}
+			else
+			{
+				const UINT blockSize{ static_cast<UINT>(BlockCompression::BLOCK_SIZE) };
+				const UINT pitch{ (levelWidth + blockSize - 1) / blockSize * BlockCompression::GetBlockBytes(blockFormat) };
+				initData[level].pSysMem = compressedMipChain[level].data();
+				initData[level].SysMemPitch = pitch;
+				initData[level].SysMemSlicePitch = pitch * ((levelHeight + blockSize - 1) / blockSize);
+			}
+		}
 
-		HRESULT hr = pDevice->CreateTexture2D(&desc, &initData, &m_pResource);
+		HRESULT hr = pDevice->CreateTexture2D(&desc, initData.data(), &m_pResource);
 
 		if (FAILED(hr))
 			return;
@@ -37,7 +85,7 @@ namespace dae
 		D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc{};
 		SRVDesc.Format = format;
 		SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		SRVDesc.Texture2D.MipLevels = 1;
+		SRVDesc.Texture2D.MipLevels = desc.MipLevels;
 
 		hr = pDevice->CreateShaderResourceView(m_pResource, &SRVDesc, &m_pSRV);
 
@@ -49,41 +97,60 @@ namespace dae
 	{
 		m_pSRV->Release();
 		m_pResource->Release();
-
-		if (m_pSurface)
-		{
-			SDL_FreeSurface(m_pSurface);
-			m_pSurface = nullptr;
-		}
 	}
 
-	Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
+	Texture* Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path, BlockFormat blockFormat)
 	{
 		//Load SDL_Surface using IMG_LOAD
 		SDL_Surface* pSurface{};
 		pSurface = IMG_Load(path.c_str());
 
 		//Create & Return a new Texture Object (using SDL_Surface)
-		Texture* newTexture{ new Texture{pDevice, pSurface} };
+		Texture* newTexture{ new Texture{pDevice, pSurface, blockFormat} };
 		return newTexture;
 	}
 
-	ColorRGB Texture::Sample(const Vector2& uv) const
+	std::vector<std::vector<uint32_t>> Texture::BuildMipChain(const SDL_Surface* pSurface)
+	{
+		// rows of the surface can be padded => pitch
+		const int width{ pSurface->w };
+		const int height{ pSurface->h };
+		std::vector<uint32_t> level0(width * height);
+		for (int y{}; y < height; ++y)
+		{
+			const uint32_t* pRow{ reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(pSurface->pixels) + y * pSurface->pitch) };
+			std::copy(pRow, pRow + width, level0.begin() + y * width);
+		}
+
+		return MipChain<uint32_t>::BuildLevels(std::move(level0), width, height);
+	}
+
+	DXGI_FORMAT Texture::GetFormat(BlockFormat blockFormat)
+	{
+		switch (blockFormat)
+		{
+		case BlockFormat::BC1:
+			return DXGI_FORMAT_BC1_UNORM;
+		case BlockFormat::BC3:
+			return DXGI_FORMAT_BC3_UNORM;
+		case BlockFormat::BC4:
+			return DXGI_FORMAT_BC4_UNORM;
+		case BlockFormat::BC5:
+			return DXGI_FORMAT_BC5_UNORM;
+		default:
+			return DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy, SampleState sampleState) const
+	{
+		return DecodeTexel(m_MipChain.Sample(uv, uvDx, uvDy, sampleState));
+	}
+
+	ColorRGB Texture::DecodeTexel(uint32_t texel) const
 	{
-		//Sample the correct texel for the given uv
-		// uv range [0, 1] to range [0, texturewidth or height]
-		const int u{ static_cast<int>(uv.x * m_pSurface->w) };
-		const int v{ static_cast<int>(uv.y * m_pSurface->h) };
-	
-		uint8_t r{};
-		uint8_t g{};
-		uint8_t b{};
-	
-		// get the color in [0, 255]
-		SDL_GetRGB(m_pSurfacePixels[u + v * m_pSurface->w], m_pSurface->format, &r, &g, &b );
-	
 		// color range to [0 ,1]
 		// optimization -> prefer multiply over devision
-		return { r * m_DivideBy255, g * m_DivideBy255, b * m_DivideBy255 };
+		return { (texel & 0xFF) * m_DivideBy255, ((texel >> 8) & 0xFF) * m_DivideBy255, ((texel >> 16) & 0xFF) * m_DivideBy255 };
 	}
-}
\ No newline at end of file
+}
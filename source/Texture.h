@@ -1,31 +1,46 @@
 #pragma once
 #include <SDL_surface.h>
 #include <string>
+#include <vector>
 #include "ColorRGB.h"
+#include "MipChain.h"
 
 namespace dae
 {
-	struct Vector2;
-
 	class Texture
 	{
 	public:
 		~Texture();
 
-		static Texture* LoadFromFile(ID3D11Device* pDevice, const std::string& path);
-		ColorRGB Sample(const Vector2& uv) const;
+		// block compressed (see BlockCompression) for the d3d texture and the software copy, sizes that aren't whole blocks stay R8G8B8A8
+		static Texture* LoadFromFile(ID3D11Device* pDevice, const std::string& path, BlockFormat blockFormat = BlockFormat::None);
+		// filtered like the d3d sampler states, see MipChain
+		ColorRGB Sample(const Vector2& uv, const Vector2& uvDx, const Vector2& uvDy, SampleState sampleState) const;
 
 		ID3D11ShaderResourceView* GetResourceView() { return m_pSRV; }
+		// r, g, b, a from the low to the high byte (R8G8B8A8_UNORM)
+		const MipChain<uint32_t>& GetMipChain() const { return m_MipChain; }
+		BlockFormat GetBlockFormat() const { return m_BlockFormat; }
 
 	private:
-		Texture(ID3D11Device* pDevice, SDL_Surface* pSurface);
+		Texture(ID3D11Device* pDevice, SDL_Surface* pSurface, BlockFormat blockFormat);
+
+		// row major texels of every mip level, level 0 is the surface without the pitch
+		static std::vector<std::vector<uint32_t>> BuildMipChain(const SDL_Surface* pSurface);
+
+		// texels are converted to one layout at load: r, g, b, a from the low to the high byte (R8G8B8A8_UNORM)
+		// => decoded with shifts and masks instead of SDL_GetRGB on the surface format
+		ColorRGB DecodeTexel(uint32_t texel) const;
+		static DXGI_FORMAT GetFormat(BlockFormat blockFormat);
 
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		// software copy of the surface pixels, full mip chain down to 1x1, 2x2 box filtered
+		// => a distant triangle reads a small level that stays in the cache instead of random texels of level 0
+		MipChain<uint32_t> m_MipChain{};
+		BlockFormat m_BlockFormat{ BlockFormat::None };
 
 		ID3D11Texture2D* m_pResource;
 		ID3D11ShaderResourceView* m_pSRV;
 
 		float m_DivideBy255{ 1.f / 255.f };
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,133 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+using namespace dae;
+
+ThreadPool::ThreadPool(int nrThreads)
+{
+	if (nrThreads <= 0)
+		nrThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+	for (int i{}; i < nrThreads; ++i)
+		m_Queues.emplace_back(std::make_unique<TaskQueue>());
+
+	// queue 0 is worked by the thread calling ParallelFor
+	for (int i{ 1 }; i < nrThreads; ++i)
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_Stop = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& worker : m_Workers)
+		worker.join();
+}
+
+void ThreadPool::ParallelFor(int nrTasks, const std::function<void(int)>& task)
+{
+	if (nrTasks <= 0)
+		return;
+
+	// nothing to share => skip the synchronization
+	if (m_Workers.empty() || nrTasks == 1)
+	{
+		for (int i{}; i < nrTasks; ++i)
+			task(i);
+		return;
+	}
+
+	m_pTask = &task;
+	m_NrTasksLeft = nrTasks;
+
+	// hand out contiguous ranges so neighbouring tasks (tiles) stay on the same thread
+	const int nrQueues{ static_cast<int>(m_Queues.size()) };
+	for (int queueIndex{}; queueIndex < nrQueues; ++queueIndex)
+	{
+		const int first{ nrTasks * queueIndex / nrQueues };
+		const int last{ nrTasks * (queueIndex + 1) / nrQueues };
+
+		std::lock_guard<std::mutex> lock{ m_Queues[queueIndex]->mutex };
+		for (int i{ first }; i < last; ++i)
+			m_Queues[queueIndex]->tasks.push_back(i);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	// help out until there is nothing left to take
+	while (RunTask(0)) {}
+
+	// wait for tasks still running on the workers
+	std::unique_lock<std::mutex> lock{ m_Mutex };
+	m_DoneCondition.wait(lock, [this]() { return m_NrTasksLeft == 0; });
+	m_pTask = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int queueIndex)
+{
+	uint64_t seenGeneration{ 0 };
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_WakeCondition.wait(lock, [&]() { return m_Stop || m_Generation != seenGeneration; });
+			if (m_Stop)
+				return;
+
+			seenGeneration = m_Generation;
+		}
+
+		while (RunTask(queueIndex)) {}
+	}
+}
+
+bool ThreadPool::RunTask(int queueIndex)
+{
+	int taskIndex{ -1 };
+
+	// own queue first (front) ...
+	{
+		TaskQueue& ownQueue{ *m_Queues[queueIndex] };
+		std::lock_guard<std::mutex> lock{ ownQueue.mutex };
+		if (!ownQueue.tasks.empty())
+		{
+			taskIndex = ownQueue.tasks.front();
+			ownQueue.tasks.pop_front();
+		}
+	}
+
+	// ... then steal from the back of the others
+	const int nrQueues{ static_cast<int>(m_Queues.size()) };
+	for (int offset{ 1 }; taskIndex < 0 && offset < nrQueues; ++offset)
+	{
+		TaskQueue& otherQueue{ *m_Queues[(queueIndex + offset) % nrQueues] };
+		std::lock_guard<std::mutex> lock{ otherQueue.mutex };
+		if (!otherQueue.tasks.empty())
+		{
+			taskIndex = otherQueue.tasks.back();
+			otherQueue.tasks.pop_back();
+		}
+	}
+
+	if (taskIndex < 0)
+		return false;
+
+	(*m_pTask)(taskIndex);
+
+	if (--m_NrTasksLeft == 0)
+	{
+		// lock so the notify can't slip in between the waiter's check and its sleep
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_DoneCondition.notify_all();
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	// Persistent pool of worker threads with one task queue per thread.
+	// A thread pops tasks from the front of its own queue and steals from the back of the others when it runs dry.
+	// The calling thread takes part in the work, so a pool of N threads spawns N - 1 workers.
+	class ThreadPool final
+	{
+	public:
+		// nrThreads = 0 => one thread per hardware core
+		ThreadPool(int nrThreads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool& other) = delete;
+		ThreadPool& operator=(const ThreadPool& other) = delete;
+		ThreadPool(ThreadPool&& other) = delete;
+		ThreadPool& operator=(ThreadPool&& other) = delete;
+
+		// calls task(index) for every index in [0, nrTasks) and returns when all of them are done
+		// not reentrant: only call from one thread at a time and never from inside a task
+		void ParallelFor(int nrTasks, const std::function<void(int)>& task);
+
+		int GetNrThreads() const { return static_cast<int>(m_Queues.size()); }
+
+	private:
+		struct TaskQueue
+		{
+			std::mutex mutex{};
+			std::deque<int> tasks{};
+		};
+
+		void WorkerLoop(int queueIndex);
+		bool RunTask(int queueIndex);
+
+		std::vector<std::thread> m_Workers{};
+		std::vector<std::unique_ptr<TaskQueue>> m_Queues{};	// [0] belongs to the calling thread
+
+		const std::function<void(int)>* m_pTask{ nullptr };
+		std::atomic<int> m_NrTasksLeft{ 0 };
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+		uint64_t m_Generation{ 0 };
+		bool m_Stop{ false };
+	};
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <cassert>
 #include <fstream>
+#include <cstring>
+#include <unordered_map>
 #include "Math.h"
 
 //#define DISABLE_OBJ
@@ -9,6 +11,41 @@ namespace dae
 {
 	namespace Utils
 	{
+		// identity of a vertex for welding: bit pattern of its position, uv and normal
+		struct VertexKey
+		{
+			uint32_t bits[8]{};
+
+			bool operator==(const VertexKey& other) const
+			{
+				return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+			}
+		};
+
+		struct VertexKeyHash
+		{
+			size_t operator()(const VertexKey& key) const
+			{
+				// FNV-1a
+				uint64_t hash{ 14695981039346656037ull };
+				for (const uint32_t value : key.bits)
+				{
+					hash ^= value;
+					hash *= 1099511628211ull;
+				}
+				return static_cast<size_t>(hash);
+			}
+		};
+
+		static VertexKey MakeVertexKey(const Vertex& vertex)
+		{
+			const float values[8]{ vertex.position.x, vertex.position.y, vertex.position.z, vertex.uv.x, vertex.uv.y, vertex.normal.x, vertex.normal.y, vertex.normal.z };
+
+			VertexKey key{};
+			std::memcpy(key.bits, values, sizeof(values));
+			return key;
+		}
+
 		//Just parses vertices and indices
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
@@ -30,6 +67,9 @@ namespace dae
 			std::vector<Vector3> normals{};
 			std::vector<Vector2> UVs{};
 
+			// welding: every unique position/uv/normal combination becomes one vertex
+			std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertexLookup{};
+
 			vertices.clear();
 			indices.clear();
 
@@ -106,28 +146,41 @@ namespace dae
 							}
 						}
 
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
+						// reuse the vertex if this combination was seen before
+						const auto [lookupIt, isNew] { vertexLookup.try_emplace(MakeVertexKey(vertex), uint32_t(vertices.size())) };
+						if (isNew)
+							vertices.push_back(vertex);
+
+						tempIndices[iFace] = lookupIt->second;
 						//indices.push_back(uint32_t(vertices.size()) - 1);
 					}
 
-					indices.push_back(tempIndices[0]);
-					if (flipAxisAndWinding) 
-					{
-						indices.push_back(tempIndices[2]);
-						indices.push_back(tempIndices[1]);
-					}
-					else
+					// drop degenerate triangles (shared vertex or no area) => never tested again at runtime
+					const bool isSharingVertex{ tempIndices[0] == tempIndices[1] || tempIndices[1] == tempIndices[2] || tempIndices[2] == tempIndices[0] };
+					const Vector3 faceNormal{ Vector3::Cross(vertices[tempIndices[1]].position - vertices[tempIndices[0]].position,
+															 vertices[tempIndices[2]].position - vertices[tempIndices[0]].position) };
+
+					if (!isSharingVertex && faceNormal.SqrMagnitude() > 0.f)
 					{
-						indices.push_back(tempIndices[1]);
-						indices.push_back(tempIndices[2]);
+						indices.push_back(tempIndices[0]);
+						if (flipAxisAndWinding) 
+						{
+							indices.push_back(tempIndices[2]);
+							indices.push_back(tempIndices[1]);
+						}
+						else
+						{
+							indices.push_back(tempIndices[1]);
+							indices.push_back(tempIndices[2]);
+						}
 					}
 				}
 				//read till end of line and ignore all remaining chars
 				file.ignore(1000, '\n');
 			}
 
-			//Cheap Tangent Calculations
+			//Cheap Tangent Calculations (accumulated on the welded vertices => averaged over every face sharing them)
+			constexpr float minUVArea{ 1e-10f };
 			for (uint32_t i = 0; i < indices.size(); i += 3)
 			{
 				uint32_t index0 = indices[i];
@@ -145,7 +198,12 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+
+				// no uv area (the vehicle has a few hundred) => no tangent direction, would add inf/nan to every face sharing the vertices
+				const float uvArea = Vector2::Cross(diffX, diffY);
+				if (std::abs(uvArea) < minUVArea)
+					continue;
+				float r = 1.f / uvArea;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].tangent += tangent;
@@ -156,7 +214,14 @@ namespace dae
 			//Fix the tangents per vertex now because we accumulated
 			for (auto& v : vertices)
 			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+				// only faces without uv area (or tangents that cancel out / lie along the normal) => any direction orthogonal to the normal
+				Vector3 tangent = Vector3::Reject(v.tangent, v.normal);
+				if (tangent.SqrMagnitude() < 1e-12f)
+				{
+					const Vector3& axis = std::abs(v.normal.x) < .9f ? Vector3::UnitX : Vector3::UnitY;
+					tangent = Vector3::Reject(axis, v.normal);
+				}
+				v.tangent = tangent.Normalized();
 
 				if(flipAxisAndWinding)
 				{
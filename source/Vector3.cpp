@@ -6,6 +6,7 @@
 
 #include "Vector4.h"
 #include "Vector2.h"
+#include "MathHelpers.h"
 
 namespace dae {
 	const Vector3 Vector3::UnitX = Vector3{ 1, 0, 0 };
@@ -45,6 +46,12 @@ namespace dae {
 		return { x / m, y / m, z / m };
 	}
 
+	Vector3 Vector3::NormalizedFast() const
+	{
+		const float inverseMagnitude = FastInverseSqrt(SqrMagnitude());
+		return { x * inverseMagnitude, y * inverseMagnitude, z * inverseMagnitude };
+	}
+
 	float Vector3::Dot(const Vector3& v1, const Vector3& v2)
 	{
 		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
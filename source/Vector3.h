@@ -19,6 +19,7 @@ namespace dae
 		float SqrMagnitude() const;
 		float Normalize();
 		Vector3 Normalized() const;
+		Vector3 NormalizedFast() const;	// FastInverseSqrt => max rel error 3e-7 per component
 
 		static float Dot(const Vector3& v1, const Vector3& v2);
 		static Vector3 Cross(const Vector3& v1, const Vector3& v2);
@@ -70,6 +70,10 @@ int main(int argc, char* args[])
 					pRenderer->CycleCullMode();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
 					pRenderer->ToggleBackgroundColor();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->CycleSampleStates();
+				if (e.key.keysym.scancode == SDL_SCANCODE_B)
+					pRenderer->ToggleTextureCompression();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
 				{
 					std::cout << COUT_COLOR_YELLOW;
@@ -86,8 +90,6 @@ int main(int argc, char* args[])
 				// only hardware
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->ToggleFireMesh();
-				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
-					pRenderer->CycleSampleStates();
 				// only software
 				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
 					pRenderer->CycleShadingMode();
@@ -97,6 +99,40 @@ int main(int argc, char* args[])
 					pRenderer->ToggleDepthBuffer();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
 					pRenderer->ToggleBoundingBox();
+				if (e.key.keysym.scancode == SDL_SCANCODE_1)
+					pRenderer->ToggleTileBinning();
+				if (e.key.keysym.scancode == SDL_SCANCODE_2)
+					pRenderer->ToggleSimd();
+				if (e.key.keysym.scancode == SDL_SCANCODE_3)
+					pRenderer->ToggleHiZ();
+				if (e.key.keysym.scancode == SDL_SCANCODE_4)
+					pRenderer->ToggleVisibilityBuffer();
+				if (e.key.keysym.scancode == SDL_SCANCODE_5)
+					pRenderer->ToggleMeshletCulling();
+				if (e.key.keysym.scancode == SDL_SCANCODE_6)
+					pRenderer->ToggleLazyTransform();
+				if (e.key.keysym.scancode == SDL_SCANCODE_7)
+					pRenderer->ToggleSimdShading();
+				if (e.key.keysym.scancode == SDL_SCANCODE_8)
+					pRenderer->ToggleFastMath();
+				if (e.key.keysym.scancode == SDL_SCANCODE_9)
+					pRenderer->BenchmarkFastMath();
+				if (e.key.keysym.scancode == SDL_SCANCODE_0)
+					pRenderer->CycleColorTarget();
+				if (e.key.keysym.scancode == SDL_SCANCODE_C)
+					pRenderer->ToggleLazyClear();
+				if (e.key.keysym.scancode == SDL_SCANCODE_Z)
+					pRenderer->CycleDepthFormat();
+				if (e.key.keysym.scancode == SDL_SCANCODE_X)
+					pRenderer->BenchmarkDepthFormats();
+				if (e.key.keysym.scancode == SDL_SCANCODE_T)
+					pRenderer->ToggleTiledLayout();
+				if (e.key.keysym.scancode == SDL_SCANCODE_Y)
+					pRenderer->BenchmarkTiledLayout();
+				if (e.key.keysym.scancode == SDL_SCANCODE_M)
+					pRenderer->ToggleMipMaps();
+				if (e.key.keysym.scancode == SDL_SCANCODE_I)
+					pRenderer->ToggleMaterialAtlas();
 			default: ;
 			}
 		}
@@ -116,6 +152,7 @@ int main(int argc, char* args[])
 			{
 				printTimer = 0.f;
 				std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+				pRenderer->PrintStatistics();
 			}
 		}
 	}